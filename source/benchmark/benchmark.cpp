@@ -0,0 +1,104 @@
+#include "log_duration.h"
+#include "process_queries.h"
+#include "search_server.h"
+
+#include <execution>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+string GenerateWord(mt19937& generator, int max_length) {
+	const int length = uniform_int_distribution(1, max_length)(generator);
+	string word;
+	word.reserve(length);
+	for (int i = 0; i < length; ++i) {
+		word.push_back(uniform_int_distribution('a', 'z')(generator));
+	}
+	return word;
+}
+
+vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
+	vector<string> words;
+	words.reserve(word_count);
+	for (int i = 0; i < word_count; ++i) {
+		words.push_back(GenerateWord(generator, max_length));
+	}
+	sort(words.begin(), words.end());
+	words.erase(unique(words.begin(), words.end()), words.end());
+	return words;
+}
+
+string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob = 0) {
+	string query;
+	for (int i = 0; i < word_count; ++i) {
+		if (!query.empty()) {
+			query.push_back(' ');
+		}
+		if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+			query.push_back('-');
+		}
+		query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+	}
+	return query;
+}
+
+vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
+	vector<string> queries;
+	queries.reserve(query_count);
+	for (int i = 0; i < query_count; ++i) {
+		queries.push_back(GenerateQuery(generator, dictionary, max_word_count, 0.1));
+	}
+	return queries;
+}
+
+template <typename ExecutionPolicy>
+void Test(const string& mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
+	LOG_DURATION(mark);
+	double total_relevance = 0;
+	for (const string& query : queries) {
+		for (const auto& document : search_server.FindTopDocuments(policy, query, DocumentStatus::ACTUAL)) {
+			total_relevance += document.relevance;
+		}
+	}
+	cout << total_relevance << endl;
+}
+
+// Usage: SearchBenchmark [document_count...]
+int main(int argc, char* argv[]) {
+	vector<int> document_counts;
+	for (int i = 1; i < argc; ++i) {
+		document_counts.push_back(stoi(argv[i]));
+	}
+	if (document_counts.empty()) {
+		document_counts = {1'000, 10'000, 100'000};
+	}
+	
+	mt19937 generator;
+	const auto dictionary = GenerateDictionary(generator, 10'000, 25);
+	const auto queries = GenerateQueries(generator, dictionary, 1'000, 7);
+	
+	for (const int document_count : document_counts) {
+		cout << "Documents: "s << document_count << endl;
+		SearchServer search_server(dictionary[0]);
+		{
+			LOG_DURATION("AddDocument"s);
+			for (int i = 0; i < document_count; ++i) {
+				search_server.AddDocument(i, GenerateQuery(generator, dictionary, 70), DocumentStatus::ACTUAL, {1, 2, 3});
+			}
+		}
+		cout << "Memory after ingestion: "s << search_server.GetMemoryStats() << endl;
+		
+		Test("seq"s, search_server, queries, execution::seq);
+		Test("par"s, search_server, queries, execution::par);
+		cout << "Memory with IDF cache: "s << search_server.GetMemoryStats() << endl;
+		
+		search_server.SetScoringMode(ScoringMode::IMPACT);
+		Test("impact"s, search_server, queries, execution::seq);
+		// Impacts are built with each sealed segment and already counted in postings
+		cout << "Memory after impact search: "s << search_server.GetMemoryStats() << endl;
+	}
+	return 0;
+}
@@ -24,4 +24,4 @@ std::ostream& operator<<(std::ostream& out, const Document& document);
 
 void PrintDocument(const Document& document);
 
-void PrintMatchDocumentResult(int document_id, const std::vector<std::string_view>& words, DocumentStatus status);
\ No newline at end of file
+void PrintMatchDocumentResult(int document_id, const std::vector<std::string>& words, DocumentStatus status);
\ No newline at end of file
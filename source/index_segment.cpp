@@ -0,0 +1,192 @@
+#include "index_segment.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+bool PostingSpan::IsDeleted(int document_id) const {
+	return segment != nullptr && segment->IsDeleted(document_id);
+}
+
+
+MutableSegment::MutableSegment(const MemoryCounters* counters)
+		: term_to_postings_(CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+		, document_ids_(CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+		{}
+
+void MutableSegment::AddPosting(string_view term, int document_id, double term_freq) {
+	auto postings = term_to_postings_.find(term);
+	if (postings == term_to_postings_.end()) {
+		postings = term_to_postings_.emplace(term, CountedVector<Posting>(term_to_postings_.get_allocator())).first;
+	}
+	postings->second.push_back({document_id, term_freq});
+}
+
+void MutableSegment::RemovePosting(string_view term, int document_id) {
+	const auto postings = term_to_postings_.find(term);
+	if (postings == term_to_postings_.end()) {
+		return;
+	}
+	auto& term_postings = postings->second;
+	term_postings.erase(remove_if(term_postings.begin(), term_postings.end(), [document_id](const Posting& posting) {
+		return posting.document_id == document_id;
+	}), term_postings.end());
+	if (term_postings.empty()) {
+		term_to_postings_.erase(postings);
+	}
+}
+
+PostingSpan MutableSegment::Find(string_view term) const {
+	const auto postings = term_to_postings_.find(term);
+	if (postings == term_to_postings_.end()) {
+		return {};
+	}
+	return {postings->second.data(), postings->second.data() + postings->second.size(), nullptr};
+}
+
+void MutableSegment::AddDocument(int document_id) {
+	document_ids_.push_back(document_id);
+}
+
+void MutableSegment::RemoveDocument(int document_id) {
+	document_ids_.erase(find(document_ids_.begin(), document_ids_.end(), document_id));
+}
+
+const CountedVector<int>& MutableSegment::GetDocumentIds() const {
+	return document_ids_;
+}
+
+void MutableSegment::Clear() {
+	term_to_postings_.clear();
+	document_ids_.clear();
+	document_ids_.shrink_to_fit();
+}
+
+
+IndexSegment::IndexSegment(const MutableSegment& segment, const MemoryCounters* counters)
+		: terms_(CountingAllocator<char>(counters, MemoryCategory::TERM_DICTIONARY))
+		, postings_offsets_(CountingAllocator<char>(counters, MemoryCategory::TERM_DICTIONARY))
+		, postings_(CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+		, document_ids_(segment.document_ids_.begin(), segment.document_ids_.end(), CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+		, ordinals_(CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+		, impacts_(CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+		, tombstones_(0, hash<int>(), equal_to<int>(), CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+{
+	sort(document_ids_.begin(), document_ids_.end());
+	size_t posting_count = 0;
+	for (const auto& [term, postings] : segment.term_to_postings_) {
+		posting_count += postings.size();
+	}
+	postings_offsets_.reserve(segment.term_to_postings_.size() + 1);
+	postings_.reserve(posting_count);
+	for (const auto& [term, postings] : segment.term_to_postings_) {
+		terms_.Append(term);
+		postings_offsets_.push_back(static_cast<uint32_t>(postings_.size()));
+		postings_.insert(postings_.end(), postings.begin(), postings.end());
+	}
+	postings_offsets_.push_back(static_cast<uint32_t>(postings_.size()));
+	BuildImpacts();
+}
+
+IndexSegment::IndexSegment(const vector<const IndexSegment*>& segments, const vector<Tombstones>& tombstones,
+                           const MemoryCounters* counters)
+		: terms_(CountingAllocator<char>(counters, MemoryCategory::TERM_DICTIONARY))
+		, postings_offsets_(CountingAllocator<char>(counters, MemoryCategory::TERM_DICTIONARY))
+		, postings_(CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+		, document_ids_(CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+		, ordinals_(CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+		, impacts_(CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+		, tombstones_(0, hash<int>(), equal_to<int>(), CountingAllocator<char>(counters, MemoryCategory::POSTINGS))
+{
+	for (size_t i = 0; i < segments.size(); ++i) {
+		for (const int document_id : segments[i]->document_ids_) {
+			if (tombstones[i].count(document_id) == 0) {
+				document_ids_.push_back(document_id);
+			}
+		}
+	}
+	sort(document_ids_.begin(), document_ids_.end());
+	
+	// Merges the sorted terms of the inputs, taking the postings of a term input by input
+	vector<FrontCodedTerms::Cursor> cursors;
+	for (const IndexSegment* segment : segments) {
+		cursors.emplace_back(segment->terms_);
+	}
+	string term;
+	while (true) {
+		const FrontCodedTerms::Cursor* smallest = nullptr;
+		for (const FrontCodedTerms::Cursor& cursor : cursors) {
+			if (cursor.IsValid() && (smallest == nullptr || cursor.GetTerm() < smallest->GetTerm())) {
+				smallest = &cursor;
+			}
+		}
+		if (smallest == nullptr) {
+			break;
+		}
+		term.assign(smallest->GetTerm());
+		const size_t postings_begin = postings_.size();
+		for (size_t i = 0; i < segments.size(); ++i) {
+			if (!cursors[i].IsValid() || cursors[i].GetTerm() != term) {
+				continue;
+			}
+			const size_t ordinal = cursors[i].GetOrdinal();
+			for (uint32_t posting = segments[i]->postings_offsets_[ordinal]; posting < segments[i]->postings_offsets_[ordinal + 1]; ++posting) {
+				if (tombstones[i].count(segments[i]->postings_[posting].document_id) == 0) {
+					postings_.push_back(segments[i]->postings_[posting]);
+				}
+			}
+			cursors[i].Next();
+		}
+		if (postings_.size() > postings_begin) {
+			terms_.Append(term);
+			postings_offsets_.push_back(static_cast<uint32_t>(postings_begin));
+		}
+	}
+	postings_offsets_.push_back(static_cast<uint32_t>(postings_.size()));
+	postings_offsets_.shrink_to_fit();
+	postings_.shrink_to_fit();
+	BuildImpacts();
+}
+
+PostingSpan IndexSegment::Find(string_view term) const {
+	const size_t ordinal = terms_.Find(term);
+	if (ordinal == FrontCodedTerms::NOT_FOUND) {
+		return {};
+	}
+	return {postings_.data() + postings_offsets_[ordinal], postings_.data() + postings_offsets_[ordinal + 1], this};
+}
+
+bool IndexSegment::ContainsLive(int document_id) const {
+	return binary_search(document_ids_.begin(), document_ids_.end(), document_id) && !IsDeleted(document_id);
+}
+
+void IndexSegment::Delete(int document_id) {
+	tombstones_.insert(document_id);
+}
+
+const Tombstones& IndexSegment::GetTombstones() const {
+	return tombstones_;
+}
+
+size_t IndexSegment::GetLiveDocumentCount() const {
+	return document_ids_.size() - tombstones_.size();
+}
+
+const CountedVector<int>& IndexSegment::GetDocumentIds() const {
+	return document_ids_;
+}
+
+void IndexSegment::BuildImpacts() {
+	unordered_map<int, uint32_t> id_to_ordinal;
+	id_to_ordinal.reserve(document_ids_.size());
+	for (size_t ordinal = 0; ordinal < document_ids_.size(); ++ordinal) {
+		id_to_ordinal.emplace(document_ids_[ordinal], static_cast<uint32_t>(ordinal));
+	}
+	ordinals_.reserve(postings_.size());
+	impacts_.reserve(postings_.size());
+	for (const Posting& posting : postings_) {
+		ordinals_.push_back(id_to_ordinal.at(posting.document_id));
+		impacts_.push_back(QuantizeTermFreq(posting.term_freq));
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "memory_stats.h"
+#include "term_dictionary.h"
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+struct Posting {
+	int document_id;
+	double term_freq;
+};
+
+// Term frequencies lie in (0, 1]; IMPACT scoring reads them quantised to 16 bits
+const double IMPACT_TF_QUANTUM = 1.0 / 65535;
+
+inline uint16_t QuantizeTermFreq(double term_freq) {
+	return static_cast<uint16_t>(std::lround(term_freq / IMPACT_TF_QUANTUM));
+}
+
+class IndexSegment;
+
+using Tombstones = std::unordered_set<int, std::hash<int>, std::equal_to<int>, CountingAllocator<int>>;
+
+// Contiguous postings of one term within one segment
+struct PostingSpan {
+	const Posting* begin = nullptr;
+	const Posting* end = nullptr;
+	const IndexSegment* segment = nullptr; // nullptr for the mutable segment, which has no tombstones
+	
+	size_t size() const {
+		return end - begin;
+	}
+	
+	bool IsDeleted(int document_id) const;
+};
+
+// Postings of the documents written since the last seal, grouped by term.
+// Terms are views that must stay alive while the segment refers to them
+class MutableSegment {
+public:
+	explicit MutableSegment(const MemoryCounters* counters);
+	
+	void AddPosting(std::string_view term, int document_id, double term_freq);
+	
+	void RemovePosting(std::string_view term, int document_id);
+	
+	PostingSpan Find(std::string_view term) const;
+	
+	void AddDocument(int document_id);
+	
+	void RemoveDocument(int document_id);
+	
+	const CountedVector<int>& GetDocumentIds() const;
+	
+	void Clear();
+
+private:
+	friend class IndexSegment;
+
+	
+	std::map<std::string_view, CountedVector<Posting>, std::less<>,
+	         CountingAllocator<std::pair<const std::string_view, CountedVector<Posting>>>> term_to_postings_;
+	CountedVector<int> document_ids_;
+};
+
+// Immutable, read-optimised terms and postings: front-coded sorted terms and the postings of
+// each term contiguous. Deletes are recorded as tombstones, which are the only
+// mutable part and must be guarded by the owner
+class IndexSegment {
+public:
+	// Seals the mutable segment
+	IndexSegment(const MutableSegment& segment, const MemoryCounters* counters);
+	
+	// Merges segments, dropping the documents deleted in each of them
+	IndexSegment(const std::vector<const IndexSegment*>& segments, const std::vector<Tombstones>& tombstones,
+	             const MemoryCounters* counters);
+	
+	PostingSpan Find(std::string_view term) const;
+	
+	// Whether the segment holds postings of the document and they are not deleted
+	bool ContainsLive(int document_id) const;
+	
+	bool IsDeleted(int document_id) const {
+		return !tombstones_.empty() && tombstones_.count(document_id) > 0;
+	}
+	
+	void Delete(int document_id);
+	
+	const Tombstones& GetTombstones() const;
+	
+	size_t GetLiveDocumentCount() const;
+	
+	// Sorted; deleted documents included
+	const CountedVector<int>& GetDocumentIds() const;
+	
+	// Parallel to the postings of a span of this segment: the position of each document in
+	// GetDocumentIds() and its quantised term frequency
+	const uint32_t* GetOrdinals(const PostingSpan& span) const {
+		return ordinals_.data() + (span.begin - postings_.data());
+	}
+	
+	const uint16_t* GetImpacts(const PostingSpan& span) const {
+		return impacts_.data() + (span.begin - postings_.data());
+	}
+
+private:
+	FrontCodedTerms terms_;
+	CountedVector<uint32_t> postings_offsets_; // the postings of term i start at [i] and end at [i + 1]
+	CountedVector<Posting> postings_;
+	CountedVector<int> document_ids_; // sorted
+	CountedVector<uint32_t> ordinals_;
+	CountedVector<uint16_t> impacts_;
+	Tombstones tombstones_;
+	
+	// Fills ordinals_ and impacts_ once postings_ and document_ids_ are final
+	void BuildImpacts();
+};
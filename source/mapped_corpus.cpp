@@ -0,0 +1,49 @@
+#include "mapped_corpus.h"
+
+#include <cerrno>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedCorpus::MappedCorpus(const string& path, CorpusFormat format)
+		: format_(format)
+{
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw system_error(errno, generic_category(), "Cannot open corpus "s + path);
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) < 0) {
+		const int error = errno;
+		close(fd);
+		throw system_error(error, generic_category(), "Cannot stat corpus "s + path);
+	}
+	size_ = static_cast<size_t>(file_stat.st_size);
+	if (size_ > 0) {
+		void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED) {
+			const int error = errno;
+			close(fd);
+			throw system_error(error, generic_category(), "Cannot map corpus "s + path);
+		}
+		// Ingestion reads the file once front to back
+		madvise(mapping, size_, MADV_SEQUENTIAL);
+		data_ = static_cast<const char*>(mapping);
+	}
+	close(fd);
+}
+
+MappedCorpus::~MappedCorpus() {
+	if (data_ != nullptr) {
+		munmap(const_cast<char*>(data_), size_);
+	}
+}
+
+string_view MappedCorpus::GetData() const {
+	return {data_, size_};
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+enum class CorpusFormat {
+	NEWLINE_DELIMITED, // one document per line
+	LENGTH_PREFIXED,   // 32-bit little-endian byte length before each document
+};
+
+// Read-only memory mapping of a corpus file. Documents are handed out as views into the
+// mapping, so their text stays in the page cache instead of the heap
+class MappedCorpus {
+public:
+	MappedCorpus(const std::string& path, CorpusFormat format);
+	
+	MappedCorpus(const MappedCorpus&) = delete;
+	MappedCorpus& operator=(const MappedCorpus&) = delete;
+	
+	~MappedCorpus();
+	
+	std::string_view GetData() const;
+	
+	// Calls handler(std::string_view document) for every document in file order
+	template <typename Handler>
+	void ForEachDocument(Handler handler) const {
+		std::string_view data = GetData();
+		if (format_ == CorpusFormat::NEWLINE_DELIMITED) {
+			while (!data.empty()) {
+				const size_t line_end = data.find('\n');
+				std::string_view line = data.substr(0, line_end);
+				if (!line.empty() && line.back() == '\r') {
+					line.remove_suffix(1);
+				}
+				handler(line);
+				if (line_end == data.npos) {
+					break;
+				}
+				data.remove_prefix(line_end + 1);
+			}
+			return;
+		}
+		
+		while (!data.empty()) {
+			if (data.size() < sizeof(uint32_t)) {
+				throw std::invalid_argument("Corpus is truncated");
+			}
+			uint32_t length = 0;
+			for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+				length |= static_cast<uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+			}
+			data.remove_prefix(sizeof(uint32_t));
+			if (length > data.size()) {
+				throw std::invalid_argument("Corpus is truncated");
+			}
+			handler(data.substr(0, length));
+			data.remove_prefix(length);
+		}
+	}
+
+private:
+	const char* data_ = nullptr;
+	size_t size_ = 0;
+	CorpusFormat format_;
+};
@@ -0,0 +1,50 @@
+#include "memory_stats.h"
+
+using namespace std;
+
+size_t MemoryStats::GetTotal() const {
+	return term_dictionary + postings + document_attributes + stored_text + forward_index + caches;
+}
+
+ostream& operator<<(ostream& out, const MemoryStats& stats) {
+	out << "{ "s
+	    << "term_dictionary = "s << stats.term_dictionary << ", "s
+	    << "postings = "s << stats.postings << ", "s
+	    << "document_attributes = "s << stats.document_attributes << ", "s
+	    << "stored_text = "s << stats.stored_text << ", "s
+	    << "forward_index = "s << stats.forward_index << ", "s
+	    << "caches = "s << stats.caches << ", "s
+	    << "total = "s << stats.GetTotal() << " }"s;
+	return out;
+}
+
+
+void MemoryCounters::Add(MemoryCategory category, size_t bytes) const {
+	bytes_[static_cast<size_t>(category)].fetch_add(bytes, memory_order_relaxed);
+}
+
+void MemoryCounters::Subtract(MemoryCategory category, size_t bytes) const {
+	bytes_[static_cast<size_t>(category)].fetch_sub(bytes, memory_order_relaxed);
+}
+
+size_t MemoryCounters::GetTotal() const {
+	size_t total = 0;
+	for (const auto& bytes : bytes_) {
+		total += bytes.load(memory_order_relaxed);
+	}
+	return total;
+}
+
+MemoryStats MemoryCounters::GetStats() const {
+	const auto get = [this](MemoryCategory category) {
+		return bytes_[static_cast<size_t>(category)].load(memory_order_relaxed);
+	};
+	MemoryStats stats;
+	stats.term_dictionary = get(MemoryCategory::TERM_DICTIONARY);
+	stats.postings = get(MemoryCategory::POSTINGS);
+	stats.document_attributes = get(MemoryCategory::DOCUMENT_ATTRIBUTES);
+	stats.stored_text = get(MemoryCategory::STORED_TEXT);
+	stats.forward_index = get(MemoryCategory::FORWARD_INDEX);
+	stats.caches = get(MemoryCategory::CACHES);
+	return stats;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class MemoryCategory {
+	TERM_DICTIONARY,
+	POSTINGS,
+	DOCUMENT_ATTRIBUTES,
+	STORED_TEXT,
+	FORWARD_INDEX,
+	CACHES,
+	COUNT,
+};
+
+// Heap bytes currently allocated by the containers of a server
+struct MemoryStats {
+	size_t term_dictionary = 0;
+	size_t postings = 0;
+	size_t document_attributes = 0;
+	size_t stored_text = 0;
+	size_t forward_index = 0;
+	size_t caches = 0;
+	
+	size_t GetTotal() const;
+};
+
+std::ostream& operator<<(std::ostream& out, const MemoryStats& stats);
+
+// Byte counters per category, updated by every CountingAllocator pointing at them
+class MemoryCounters {
+public:
+	void Add(MemoryCategory category, size_t bytes) const;
+	void Subtract(MemoryCategory category, size_t bytes) const;
+	
+	size_t GetTotal() const;
+	MemoryStats GetStats() const;
+
+private:
+	mutable std::array<std::atomic<size_t>, static_cast<size_t>(MemoryCategory::COUNT)> bytes_{};
+};
+
+// Forwards to std::allocator and charges every allocation to one category of the counters,
+// which must outlive the allocator and everything allocated through it
+template <typename T>
+class CountingAllocator {
+public:
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::true_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+	
+	CountingAllocator(const MemoryCounters* counters, MemoryCategory category) noexcept
+			: counters_(counters)
+			, category_(category) {
+	}
+	
+	template <typename U>
+	CountingAllocator(const CountingAllocator<U>& other) noexcept
+			: counters_(other.GetCounters())
+			, category_(other.GetCategory()) {
+	}
+	
+	T* allocate(size_t n) {
+		T* result = std::allocator<T>().allocate(n);
+		counters_->Add(category_, n * sizeof(T));
+		return result;
+	}
+	
+	void deallocate(T* p, size_t n) noexcept {
+		counters_->Subtract(category_, n * sizeof(T));
+		std::allocator<T>().deallocate(p, n);
+	}
+	
+	const MemoryCounters* GetCounters() const {
+		return counters_;
+	}
+	
+	MemoryCategory GetCategory() const {
+		return category_;
+	}
+
+private:
+	const MemoryCounters* counters_;
+	MemoryCategory category_;
+};
+
+template <typename T, typename U>
+bool operator==(const CountingAllocator<T>& lhs, const CountingAllocator<U>& rhs) {
+	return lhs.GetCounters() == rhs.GetCounters() && lhs.GetCategory() == rhs.GetCategory();
+}
+
+template <typename T, typename U>
+bool operator!=(const CountingAllocator<T>& lhs, const CountingAllocator<U>& rhs) {
+	return !(lhs == rhs);
+}
+
+using CountedString = std::basic_string<char, std::char_traits<char>, CountingAllocator<char>>;
+
+template <typename T>
+using CountedVector = std::vector<T, CountingAllocator<T>>;
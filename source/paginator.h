@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <iterator>
 #include <vector>
 
 template <typename Iterator>
@@ -66,6 +67,87 @@ private:
 	std::vector<IteratorRange<Iterator>> pages_;
 };
 
+// Computes page boundaries on demand instead of building every page up front
+template <typename Iterator>
+class LazyPaginator {
+public:
+	class PageIterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = IteratorRange<Iterator>;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const value_type*;
+		using reference = value_type;
+		
+		PageIterator(Iterator begin, size_t left, size_t page_size)
+				: begin_(begin)
+				, left_(left)
+				, page_size_(page_size) {
+		}
+		
+		IteratorRange<Iterator> operator*() const {
+			return {begin_, next(begin_, std::min(page_size_, left_))};
+		}
+		
+		PageIterator& operator++() {
+			const size_t current_page_size = std::min(page_size_, left_);
+			begin_ = next(begin_, current_page_size);
+			left_ -= current_page_size;
+			return *this;
+		}
+		
+		bool operator==(const PageIterator& other) const {
+			return left_ == other.left_;
+		}
+		
+		bool operator!=(const PageIterator& other) const {
+			return !(*this == other);
+		}
+	
+	private:
+		Iterator begin_;
+		size_t left_;
+		size_t page_size_;
+	};
+	
+	LazyPaginator(Iterator begin, Iterator end, size_t page_size)
+			: begin_(begin)
+			, end_(end)
+			, item_count_(distance(begin, end))
+			, page_size_(page_size) {
+	}
+	
+	// Constant time for random access iterators
+	IteratorRange<Iterator> GetPage(size_t index) const {
+		const size_t offset = std::min(index * page_size_, item_count_);
+		const Iterator page_begin = next(begin_, offset);
+		return {page_begin, next(page_begin, std::min(page_size_, item_count_ - offset))};
+	}
+	
+	PageIterator begin() const {
+		return {begin_, page_size_ == 0 ? 0 : item_count_, page_size_};
+	}
+	
+	PageIterator end() const {
+		return {end_, 0, page_size_};
+	}
+	
+	size_t size() const {
+		return page_size_ == 0 ? 0 : (item_count_ + page_size_ - 1) / page_size_;
+	}
+
+private:
+	Iterator begin_, end_;
+	size_t item_count_;
+	size_t page_size_;
+};
+
 template <typename Container>
 auto Paginate(const Container& c, size_t page_size) {
 	return Paginator(begin(c), end(c), page_size);
+}
+
+template <typename Container>
+auto PaginateLazy(const Container& c, size_t page_size) {
+	return LazyPaginator(begin(c), end(c), page_size);
+}
@@ -1,38 +1,30 @@
 #include "process_queries.h"
 
-#include <algorithm>
-#include <numeric>
-#include <functional>
-#include <execution>
-
-
 using namespace std;
 
 vector<vector<Document>> ProcessQueries( const SearchServer& search_server,
 											const vector<string>& queries) {
 	vector<vector<Document>> result(queries.size());
-	transform(execution::par, queries.begin(), queries.end(), result.begin(), [&search_server](const string& query){
-		return search_server.FindTopDocuments(query);});
+	// Queries run sequentially inside, one pool task each
+	search_server.GetThreadPool().ParallelFor(queries.size(), [&](size_t i) {
+		result[i] = search_server.FindTopDocuments(queries[i]);
+	});
 	return result;
 }
 
 vector<Document> ProcessQueriesJoined(const SearchServer& search_server,
 													const vector<string>& queries) {
-	int total_size = 0;
 	vector<vector<Document>> process_queries_result = ProcessQueries(search_server, queries);
 
-	vector<size_t> v(process_queries_result.size());
-	
-	transform_inclusive_scan(execution::par, process_queries_result.begin(),
-				process_queries_result.end(), v.begin(), plus<>{},
-				[](const vector<Document>& vd){ return vd.size(); }, 0);
-
-	total_size = v.back();
-	vector<Document> result(total_size);
-	auto it = result.begin();
-	for(auto & i : process_queries_result) {
-		it = transform(execution::par, i.begin(), i.end(), it,
-		                              [](const Document &doc) { return doc; });
+	// Copying at most MAX_RESULT_DOCUMENT_COUNT documents per query is cheaper than another parallel pass
+	size_t total_size = 0;
+	for (const vector<Document>& documents : process_queries_result) {
+		total_size += documents.size();
+	}
+	vector<Document> result;
+	result.reserve(total_size);
+	for (const vector<Document>& documents : process_queries_result) {
+		result.insert(result.end(), documents.begin(), documents.end());
 	}
 	return result;
 }
@@ -0,0 +1,36 @@
+#include "query_budget.h"
+
+using namespace std;
+
+CancellationToken::CancellationToken()
+		: cancelled_(make_shared<atomic<bool>>(false))
+		{}
+
+void CancellationToken::Cancel() const {
+	cancelled_->store(true);
+}
+
+bool CancellationToken::IsCancelled() const {
+	return cancelled_->load();
+}
+
+
+QueryBudget::QueryBudget(Clock::time_point deadline, CancellationToken token)
+		: deadline_(deadline)
+		, token_(move(token))
+		{}
+
+bool QueryBudget::Check() const {
+	if (exhausted_.load(memory_order_relaxed)) {
+		return false;
+	}
+	if (token_.IsCancelled() || Clock::now() >= deadline_) {
+		exhausted_.store(true, memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+bool QueryBudget::IsExhausted() const {
+	return exhausted_.load(memory_order_relaxed);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "document.h"
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <vector>
+
+// Shared flag that stops a running search; copies refer to the same flag
+class CancellationToken {
+public:
+	CancellationToken();
+	
+	void Cancel() const;
+	
+	bool IsCancelled() const;
+
+private:
+	std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+// Deadline and cancellation checked by a search between posting blocks
+class QueryBudget {
+public:
+	using Clock = std::chrono::steady_clock;
+	
+	explicit QueryBudget(Clock::time_point deadline, CancellationToken token = CancellationToken());
+	
+	// false once the deadline has passed or the token was cancelled, and from then on
+	bool Check() const;
+	
+	bool IsExhausted() const;
+
+private:
+	Clock::time_point deadline_;
+	CancellationToken token_;
+	mutable std::atomic<bool> exhausted_{false};
+};
+
+struct SearchResult {
+	std::vector<Document> documents;
+	bool is_partial = false; // the budget ran out and documents are the best found so far
+	std::exception_ptr error; // an asynchronous search threw; documents are then empty
+};
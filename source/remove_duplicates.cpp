@@ -0,0 +1,170 @@
+#include "remove_duplicates.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+const int MINHASH_BANDS = 16;
+const int MINHASH_ROWS = 4;
+const int MINHASH_SIZE = MINHASH_BANDS * MINHASH_ROWS;
+// Documents of an LSH bucket are compared with at most this many earlier kept members, which keeps
+// buckets of short, loosely similar documents from going quadratic. True near-duplicates share
+// many bands, so they still meet in a smaller bucket
+const size_t MAX_BUCKET_COMPARISONS = 32;
+
+using WordFrequencies = SearchServer::WordFrequencies;
+using MinHashSignature = vector<uint64_t>;
+
+// splitmix64 finalizer
+uint64_t Mix(uint64_t x) {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+MinHashSignature ComputeMinHash(const WordFrequencies& word_to_freq) {
+	MinHashSignature signature(MINHASH_SIZE, numeric_limits<uint64_t>::max());
+	for (const auto& [word, _] : word_to_freq) {
+		const uint64_t word_hash = hash<string_view>{}(word);
+		for (int i = 0; i < MINHASH_SIZE; ++i) {
+			signature[i] = min(signature[i], Mix(word_hash ^ Mix(i)));
+		}
+	}
+	return signature;
+}
+
+bool HaveSameWords(const WordFrequencies& lhs, const WordFrequencies& rhs) {
+	return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+	             [](const auto& lhs_word, const auto& rhs_word) { return lhs_word.first == rhs_word.first; });
+}
+
+double ComputeJaccardSimilarity(const WordFrequencies& lhs, const WordFrequencies& rhs) {
+	if (lhs.empty() && rhs.empty()) {
+		return 1.0;
+	}
+	size_t common_count = 0;
+	auto lhs_it = lhs.begin();
+	auto rhs_it = rhs.begin();
+	while (lhs_it != lhs.end() && rhs_it != rhs.end()) {
+		if (lhs_it->first < rhs_it->first) {
+			++lhs_it;
+		}
+		else if (rhs_it->first < lhs_it->first) {
+			++rhs_it;
+		}
+		else {
+			++common_count;
+			++lhs_it;
+			++rhs_it;
+		}
+	}
+	return common_count * 1.0 / (lhs.size() + rhs.size() - common_count);
+}
+
+} // namespace
+
+vector<int> FindDuplicates(const SearchServer& search_server, double similarity_threshold) {
+	if (!(similarity_threshold > 0.0 && similarity_threshold <= 1.0)) {
+		throw invalid_argument("Similarity threshold must be in (0, 1]"s);
+	}
+	vector<int> document_ids(search_server.begin(), search_server.end());
+	sort(document_ids.begin(), document_ids.end());
+	
+	vector<const WordFrequencies*> word_frequencies(document_ids.size());
+	vector<uint64_t> word_set_hashes(document_ids.size());
+	search_server.GetThreadPool().ParallelFor(document_ids.size(), [&](size_t i) {
+		word_frequencies[i] = &search_server.GetWordFrequencies(document_ids[i]);
+		word_set_hashes[i] = search_server.GetWordSetHash(document_ids[i]);
+	});
+	
+	vector<bool> is_duplicate(document_ids.size(), false);
+	
+	// Identical word sets; hash collisions are told apart by comparing the sets
+	vector<size_t> distinct_documents;
+	unordered_map<uint64_t, vector<size_t>> hash_to_distinct_documents;
+	for (size_t i = 0; i < document_ids.size(); ++i) {
+		vector<size_t>& same_hash = hash_to_distinct_documents[word_set_hashes[i]];
+		const auto original = find_if(same_hash.begin(), same_hash.end(), [&](size_t other) {
+			return HaveSameWords(*word_frequencies[i], *word_frequencies[other]);
+		});
+		if (original != same_hash.end()) {
+			is_duplicate[i] = true;
+		}
+		else {
+			same_hash.push_back(i);
+			distinct_documents.push_back(i);
+		}
+	}
+	
+	// Near-duplicates among distinct word sets: documents sharing any band of their MinHash
+	// signatures become candidates. In id order, a document is kept unless its exact Jaccard
+	// similarity to an earlier kept candidate reaches the threshold, so similarity never chains
+	// through a removed document
+	if (similarity_threshold < 1.0) {
+		vector<MinHashSignature> signatures(distinct_documents.size());
+		search_server.GetThreadPool().ParallelFor(distinct_documents.size(), [&](size_t k) {
+			signatures[k] = ComputeMinHash(*word_frequencies[distinct_documents[k]]);
+		});
+		// Per band, the buckets in ascending document order and the bucket of every document
+		vector<vector<vector<size_t>>> band_buckets(MINHASH_BANDS);
+		vector<vector<size_t>> document_buckets(MINHASH_BANDS, vector<size_t>(distinct_documents.size()));
+		for (int band = 0; band < MINHASH_BANDS; ++band) {
+			unordered_map<uint64_t, size_t> hash_to_bucket;
+			for (size_t k = 0; k < distinct_documents.size(); ++k) {
+				uint64_t band_hash = band;
+				for (int row = 0; row < MINHASH_ROWS; ++row) {
+					band_hash = Mix(band_hash ^ signatures[k][band * MINHASH_ROWS + row]);
+				}
+				const auto [bucket, is_new] = hash_to_bucket.emplace(band_hash, band_buckets[band].size());
+				if (is_new) {
+					band_buckets[band].emplace_back();
+				}
+				band_buckets[band][bucket->second].push_back(distinct_documents[k]);
+				document_buckets[band][k] = bucket->second;
+			}
+		}
+		for (size_t k = 0; k < distinct_documents.size(); ++k) {
+			const size_t document = distinct_documents[k];
+			for (int band = 0; band < MINHASH_BANDS && !is_duplicate[document]; ++band) {
+				size_t comparison_count = 0;
+				for (const size_t other : band_buckets[band][document_buckets[band][k]]) {
+					if (other >= document || comparison_count == MAX_BUCKET_COMPARISONS) {
+						break;
+					}
+					if (is_duplicate[other]) {
+						continue;
+					}
+					++comparison_count;
+					if (ComputeJaccardSimilarity(*word_frequencies[document], *word_frequencies[other]) >= similarity_threshold) {
+						is_duplicate[document] = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+	
+	vector<int> duplicate_ids;
+	for (size_t i = 0; i < document_ids.size(); ++i) {
+		if (is_duplicate[i]) {
+			duplicate_ids.push_back(document_ids[i]);
+		}
+	}
+	return duplicate_ids;
+}
+
+void RemoveDuplicates(SearchServer& search_server, double similarity_threshold) {
+	for (const int document_id : FindDuplicates(search_server, similarity_threshold)) {
+		cout << "Found duplicate document id "s << document_id << endl;
+		search_server.RemoveDocument(document_id);
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <vector>
+
+// Ids of documents that duplicate a kept document with a lower id, in ascending order.
+// Identical word sets are grouped by their hashes. A similarity_threshold below 1 also matches
+// word sets whose Jaccard similarity to a kept document reaches it, found through MinHash
+// signatures bucketed by LSH. Reads the word frequencies of every document without a lock, so no
+// document may be added or removed meanwhile
+std::vector<int> FindDuplicates(const SearchServer& search_server, double similarity_threshold = 1.0);
+
+void RemoveDuplicates(SearchServer& search_server, double similarity_threshold = 1.0);
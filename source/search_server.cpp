@@ -1,11 +1,27 @@
 #include "search_server.h"
 #include "string_processing.h"
 #include <numeric>
+#include <limits>
+#include <thread>
 
 #include "log_duration.h"
 
 using namespace std;
 
+SearchServer::DocumentData::DocumentData(const MemoryCounters* counters)
+		: word_to_freq(CountingAllocator<char>(counters, MemoryCategory::FORWARD_INDEX))
+		, owned_text(CountingAllocator<char>(counters, MemoryCategory::STORED_TEXT))
+		{}
+
+SearchServer::PrefixExpansion::PrefixExpansion(const CountingAllocator<char>& allocator)
+		: terms(allocator)
+		{}
+
+SearchServer::PrefixPostings::PrefixPostings(const CountingAllocator<char>& allocator)
+		: postings(allocator)
+		{}
+
+
 SearchServer::SearchServer(const string& stop_words_text)
 		: SearchServer(string_view(stop_words_text))  // Invoke delegating constructor from string container
 		{}
@@ -14,30 +30,424 @@ SearchServer::SearchServer(string_view stop_words_text)
 	: SearchServer(SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string_view 
 {}
 
+SearchServer::~SearchServer() {
+	if (merge_thread_.joinable()) {
+		{
+			lock_guard lock(merge_mutex_);
+			stopping_ = true;
+		}
+		merge_cv_.notify_all();
+		merge_thread_.join();
+	}
+}
+
 
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+	unique_lock lock(index_mutex_);
 	if ((document_id < 0) || (documents_.count(document_id) > 0)) {
 		throw invalid_argument("Invalid document_id"s);
 	}
+	CountedString owned_text(document, MakeAllocator(MemoryCategory::STORED_TEXT));
+	const string_view text = owned_text;
+	IndexDocument(document_id, text, status, ratings);
+	// Moving a short string would move its inline buffer, so re-point the view afterwards
+	DocumentData& document_data = documents_.at(document_id);
+	document_data.owned_text = move(owned_text);
+	document_data.text = document_data.owned_text;
+}
+
+
+int SearchServer::AddDocuments(shared_ptr<const MappedCorpus> corpus, int first_document_id, DocumentStatus status,
+                               const vector<int>& ratings) {
+	// Kept before indexing so that documents added before a failure still view a live mapping
+	{
+		unique_lock lock(index_mutex_);
+		corpora_.push_back(corpus);
+	}
+	int document_id = first_document_id;
+	corpus->ForEachDocument([&](string_view document) {
+		if (document.empty()) {
+			return;
+		}
+		unique_lock lock(index_mutex_);
+		if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+			throw invalid_argument("Invalid document_id"s);
+		}
+		IndexDocument(document_id, document, status, ratings);
+		documents_.at(document_id).text = document;
+		++document_id;
+	});
+	return document_id - first_document_id;
+}
+
+
+void SearchServer::IndexDocument(int document_id, string_view text, DocumentStatus status, const vector<int>& ratings) {
+	const auto words = SplitIntoWordsNoStop(text);
+
+	vector<string_view> word_set = words;
+	sort(word_set.begin(), word_set.end());
+	word_set.erase(unique(word_set.begin(), word_set.end()), word_set.end());
+	const uint64_t word_set_hash = HashWordSet(word_set);
+	if (duplicate_policy_ == DuplicatePolicy::REJECT_EXACT) {
+		const auto [same_hash_begin, same_hash_end] = word_set_hash_to_document_ids_.equal_range(word_set_hash);
+		for (auto it = same_hash_begin; it != same_hash_end; ++it) {
+			const auto& other_word_to_freq = documents_.at(it->second).word_to_freq;
+			if (equal(word_set.begin(), word_set.end(), other_word_to_freq.begin(), other_word_to_freq.end(),
+			          [](string_view word, const auto& other) { return word == other.first; })) {
+				throw invalid_argument("Document "s + to_string(document_id) + " duplicates document "s + to_string(it->second));
+			}
+		}
+	}
 
-	documents_[document_id].rating = ComputeAverageRating(ratings);
-	documents_[document_id].status = status;
-	documents_[document_id].text = string(document);
+	if (IsOverMemoryBudget()) {
+		InvalidateCaches();
+	}
 
-	const auto words = SplitIntoWordsNoStop(documents_[document_id].text);
+	DocumentData& document_data = documents_.emplace(document_id, DocumentData(&memory_counters_)).first->second;
+	document_data.rating = ComputeAverageRating(ratings);
+	document_data.status = status;
+	document_data.word_set_hash = word_set_hash;
+	word_set_hash_to_document_ids_.emplace(word_set_hash, document_id);
+	auto rating_bucket = rating_to_document_ids_.find(document_data.rating);
+	if (rating_bucket == rating_to_document_ids_.end()) {
+		rating_bucket = rating_to_document_ids_.emplace(document_data.rating, CountedVector<int>(rating_to_document_ids_.get_allocator())).first;
+	}
+	CountedVector<int>& rating_ids = rating_bucket->second;
+	rating_ids.insert(lower_bound(rating_ids.begin(), rating_ids.end(), document_id), document_id);
 
-	map<string, double> word_to_freq;
 	const double inv_word_count = 1.0 / words.size();
-	for (const string& word : words) {
-		if (word_to_document_freqs_[word].count(document_id) == 0) {
-			word_to_document_freqs_[word][document_id] = 0.0;
-			word_to_freq[word] = 0.0;
+	for (const string_view word : words) {
+		auto term = word_to_document_freqs_.find(word);
+		if (term == word_to_document_freqs_.end()) {
+			term = word_to_document_freqs_.emplace(CountedString(word, MakeAllocator(MemoryCategory::TERM_DICTIONARY)),
+			                                       TermInfo()).first;
 		}
-		word_to_document_freqs_[word][document_id] += inv_word_count;
-		word_to_freq[word] += inv_word_count;
-		
+		document_data.word_to_freq[term->first] += inv_word_count;
 	}
+	for (const auto& [word, term_freq] : document_data.word_to_freq) {
+		++word_to_document_freqs_.find(word)->second.document_count;
+		mutable_segment_.AddPosting(word, document_id, term_freq);
+	}
+	mutable_segment_.AddDocument(document_id);
 	document_ids_.push_back(document_id);
+	InvalidateCaches();
+
+	if (IsOverMemoryBudget()) {
+		UnindexDocument(document_id);
+		throw length_error("Memory budget exceeded by document "s + to_string(document_id));
+	}
+	if (mutable_segment_.GetDocumentIds().size() >= segment_capacity_) {
+		SealMutableSegment();
+	}
+}
+
+
+void SearchServer::UnindexDocument(int document_id) {
+	const auto document = documents_.find(document_id);
+	if (document == documents_.end()) {
+		return;
+	}
+	if (document->second.in_mutable_segment) {
+		for (const auto& [word, _] : document->second.word_to_freq) {
+			mutable_segment_.RemovePosting(word, document_id);
+		}
+		mutable_segment_.RemoveDocument(document_id);
+	}
+	else {
+		for (const auto& segment : sealed_segments_) {
+			if (segment->ContainsLive(document_id)) {
+				segment->Delete(document_id);
+				break;
+			}
+		}
+	}
+	for (const auto& [word, _] : document->second.word_to_freq) {
+		const auto term = word_to_document_freqs_.find(word);
+		if (--term->second.document_count == 0) {
+			word_to_document_freqs_.erase(term);
+		}
+	}
+	const auto [same_hash_begin, same_hash_end] = word_set_hash_to_document_ids_.equal_range(document->second.word_set_hash);
+	for (auto it = same_hash_begin; it != same_hash_end; ++it) {
+		if (it->second == document_id) {
+			word_set_hash_to_document_ids_.erase(it);
+			break;
+		}
+	}
+	const auto rating_bucket = rating_to_document_ids_.find(document->second.rating);
+	CountedVector<int>& rating_ids = rating_bucket->second;
+	rating_ids.erase(lower_bound(rating_ids.begin(), rating_ids.end(), document_id));
+	if (rating_ids.empty()) {
+		rating_to_document_ids_.erase(rating_bucket);
+	}
+	documents_.erase(document);
+	document_ids_.erase(find(document_ids_.begin(), document_ids_.end(), document_id));
+	InvalidateCaches();
+}
+
+
+void SearchServer::SealMutableSegment() {
+	sealed_segments_.push_back(make_shared<IndexSegment>(mutable_segment_, &memory_counters_));
+	for (const int document_id : mutable_segment_.GetDocumentIds()) {
+		documents_.at(document_id).in_mutable_segment = false;
+	}
+	mutable_segment_.Clear();
+	
+	lock_guard lock(merge_mutex_);
+	merge_requested_ = true;
+	if (!merge_thread_.joinable()) {
+		merge_thread_ = thread([this] { RunMerges(); });
+	}
+	merge_cv_.notify_all();
+}
+
+
+void SearchServer::RunMerges() {
+	unique_lock lock(merge_mutex_);
+	while (true) {
+		merge_cv_.wait(lock, [this] { return stopping_ || merge_requested_; });
+		if (stopping_) {
+			return;
+		}
+		merge_requested_ = false;
+		merging_ = true;
+		lock.unlock();
+		while (!stopping_ && MergeSegmentsOnce()) {
+		}
+		lock.lock();
+		merging_ = false;
+		merge_cv_.notify_all();
+	}
+}
+
+
+bool SearchServer::MergeSegmentsOnce() {
+	vector<shared_ptr<IndexSegment>> inputs;
+	vector<Tombstones> tombstones;
+	{
+		shared_lock lock(index_mutex_);
+		// Tier k holds segments of up to capacity * SEGMENT_MERGE_FACTOR^k live documents
+		map<int, vector<shared_ptr<IndexSegment>>> tiers;
+		for (const auto& segment : sealed_segments_) {
+			int tier = 0;
+			for (size_t tier_capacity = segment_capacity_; segment->GetLiveDocumentCount() > tier_capacity; tier_capacity *= SEGMENT_MERGE_FACTOR) {
+				++tier;
+			}
+			tiers[tier].push_back(segment);
+		}
+		for (auto& [_, segments] : tiers) {
+			if (segments.size() >= SEGMENT_MERGE_FACTOR) {
+				segments.resize(SEGMENT_MERGE_FACTOR);
+				inputs = move(segments);
+				break;
+			}
+		}
+		if (inputs.empty()) {
+			return false;
+		}
+		for (const auto& segment : inputs) {
+			tombstones.push_back(segment->GetTombstones());
+		}
+	}
+	
+	// Built without the lock: sealed terms and postings never change, and tombstones are snapshotted
+	vector<const IndexSegment*> segments;
+	for (const auto& segment : inputs) {
+		segments.push_back(segment.get());
+	}
+	auto merged = make_shared<IndexSegment>(segments, tombstones, &memory_counters_);
+	
+	unique_lock lock(index_mutex_);
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		// Documents deleted while merging
+		for (const int document_id : inputs[i]->GetTombstones()) {
+			if (tombstones[i].count(document_id) == 0) {
+				merged->Delete(document_id);
+			}
+		}
+	}
+	const auto first_input = find(sealed_segments_.begin(), sealed_segments_.end(), inputs.front());
+	*first_input = move(merged);
+	sealed_segments_.erase(remove_if(sealed_segments_.begin(), sealed_segments_.end(), [&inputs](const auto& segment) {
+		return find(inputs.begin(), inputs.end(), segment) != inputs.end();
+	}), sealed_segments_.end());
+	return true;
+}
+
+
+SearchServer::TermPostings SearchServer::FindTermPostings(string_view word) const {
+	const auto term = word_to_document_freqs_.find(word);
+	if (term == word_to_document_freqs_.end()) {
+		return {};
+	}
+	return FindTermPostings(*term);
+}
+
+SearchServer::TermPostings SearchServer::FindTermPostings(const DictionaryEntry& term) const {
+	TermPostings result;
+	result.info = &term.second;
+	for (const auto& segment : sealed_segments_) {
+		const PostingSpan span = segment->Find(term.first);
+		if (span.size() > 0) {
+			result.spans.push_back(span);
+		}
+	}
+	const PostingSpan span = mutable_segment_.Find(term.first);
+	if (span.size() > 0) {
+		result.spans.push_back(span);
+	}
+	return result;
+}
+
+
+shared_ptr<const SearchServer::PrefixExpansion> SearchServer::ExpandPrefix(string_view prefix) const {
+	{
+		shared_lock lock(cache_mutex_);
+		const auto it = prefix_expansion_cache_.find(prefix);
+		if (it != prefix_expansion_cache_.end()) {
+			return it->second;
+		}
+	}
+	// Heap of the terms kept so far with the least frequent, then greatest, one on top.
+	// Of equally frequent terms the smallest ones are kept
+	const auto is_more_frequent = [](const DictionaryEntry* lhs, const DictionaryEntry* rhs) {
+		return lhs->second.document_count != rhs->second.document_count
+		       ? lhs->second.document_count > rhs->second.document_count
+		       : lhs->first < rhs->first;
+	};
+	auto expansion = make_shared<PrefixExpansion>(MakeAllocator(MemoryCategory::CACHES));
+	CountedVector<const DictionaryEntry*>& terms = expansion->terms;
+	for (auto term = word_to_document_freqs_.lower_bound(prefix);
+	     term != word_to_document_freqs_.end() && string_view(term->first).substr(0, prefix.size()) == prefix; ++term) {
+		if (terms.size() < MAX_PREFIX_EXPANSIONS) {
+			terms.push_back(&*term);
+			push_heap(terms.begin(), terms.end(), is_more_frequent);
+		}
+		else if (is_more_frequent(&*term, terms.front())) {
+			pop_heap(terms.begin(), terms.end(), is_more_frequent);
+			terms.back() = &*term;
+			push_heap(terms.begin(), terms.end(), is_more_frequent);
+		}
+	}
+	sort(terms.begin(), terms.end(), [](const DictionaryEntry* lhs, const DictionaryEntry* rhs) {
+		return lhs->first < rhs->first;
+	});
+	terms.shrink_to_fit();
+	if (!IsOverMemoryBudget()) {
+		unique_lock lock(cache_mutex_);
+		if (prefix_expansion_cache_.size() >= MAX_CACHED_PREFIXES) {
+			prefix_expansion_cache_.clear();
+		}
+		prefix_expansion_cache_.emplace(CountedString(prefix, MakeAllocator(MemoryCategory::CACHES)), expansion);
+	}
+	return expansion;
+}
+
+
+shared_ptr<const SearchServer::PrefixPostings> SearchServer::GetPrefixPostings(string_view prefix) const {
+	{
+		shared_lock lock(cache_mutex_);
+		const auto it = prefix_cache_.find(prefix);
+		if (it != prefix_cache_.end()) {
+			return it->second;
+		}
+	}
+	// Held here, as another reader may clear the cache meanwhile
+	const shared_ptr<const PrefixExpansion> expansion = ExpandPrefix(prefix);
+	vector<Posting> postings;
+	for (const DictionaryEntry* term : expansion->terms) {
+		for (const PostingSpan& span : FindTermPostings(*term).spans) {
+			for (const Posting* posting = span.begin; posting != span.end; ++posting) {
+				if (!span.IsDeleted(posting->document_id)) {
+					postings.push_back(*posting);
+				}
+			}
+		}
+	}
+	sort(postings.begin(), postings.end(), [](const Posting& lhs, const Posting& rhs) {
+		return lhs.document_id < rhs.document_id;
+	});
+	
+	auto prefix_postings = make_shared<PrefixPostings>(MakeAllocator(MemoryCategory::CACHES));
+	for (const Posting& posting : postings) {
+		if (!prefix_postings->postings.empty() && prefix_postings->postings.back().document_id == posting.document_id) {
+			prefix_postings->postings.back().term_freq += posting.term_freq;
+		}
+		else {
+			prefix_postings->postings.push_back(posting);
+		}
+	}
+	prefix_postings->postings.shrink_to_fit();
+	if (!IsOverMemoryBudget()) {
+		unique_lock lock(cache_mutex_);
+		if (prefix_cache_.size() >= MAX_CACHED_PREFIXES) {
+			prefix_cache_.clear();
+		}
+		prefix_cache_.emplace(CountedString(prefix, MakeAllocator(MemoryCategory::CACHES)), prefix_postings);
+	}
+	return prefix_postings;
+}
+
+
+vector<SearchServer::ScoredTerm> SearchServer::ResolvePlusTerms(const Query& query) const {
+	vector<ScoredTerm> terms;
+	for (const string_view word : query.plus_words) {
+		const auto term = word_to_document_freqs_.find(word);
+		if (term != word_to_document_freqs_.end()) {
+			terms.push_back({ComputeWordInverseDocumentFreq(term->second), FindTermPostings(*term).spans, nullptr});
+		}
+	}
+	for (const string_view prefix : query.plus_prefixes) {
+		shared_ptr<const PrefixPostings> prefix_postings = GetPrefixPostings(prefix);
+		const auto& postings = prefix_postings->postings;
+		if (!postings.empty()) {
+			terms.push_back({log(documents_.size() * 1.0 / postings.size()),
+			                 {PostingSpan{postings.data(), postings.data() + postings.size(), nullptr}}, move(prefix_postings)});
+		}
+	}
+	return terms;
+}
+
+
+bool SearchServer::IsImpactScored(const Query& query) const {
+	// Prefix terms have no impact postings
+	return scoring_mode_ == ScoringMode::IMPACT && query.plus_prefixes.empty() && query.plus_words.size() <= IMPACT_MAX_TERMS;
+}
+
+SearchServer::ImpactWeights SearchServer::QuantizeWeights(const vector<double>& inverse_document_freqs) {
+	ImpactWeights result;
+	result.weights.resize(inverse_document_freqs.size());
+	const double max_inverse_document_freq = inverse_document_freqs.empty()
+	                                         ? 0.0
+	                                         : *max_element(inverse_document_freqs.begin(), inverse_document_freqs.end());
+	// A term of every document has zero IDF and so has every weight then
+	if (max_inverse_document_freq <= 0.0) {
+		return result;
+	}
+	const double weight_quantum = max_inverse_document_freq / IMPACT_MAX_WEIGHT;
+	for (size_t i = 0; i < inverse_document_freqs.size(); ++i) {
+		result.weights[i] = static_cast<uint32_t>(lround(inverse_document_freqs[i] / weight_quantum));
+	}
+	result.scale = weight_quantum * IMPACT_TF_QUANTUM;
+	return result;
+}
+
+SearchServer::ImpactScratch& SearchServer::GetImpactScratch() {
+	thread_local ImpactScratch scratch;
+	return scratch;
+}
+
+
+vector<PostingSpan> SearchServer::SplitIntoBlocks(const vector<PostingSpan>& spans) {
+	vector<PostingSpan> blocks;
+	for (const PostingSpan& span : spans) {
+		for (const Posting* block_begin = span.begin; block_begin != span.end;) {
+			const Posting* block_end = block_begin + min(POSTING_BLOCK_SIZE, static_cast<size_t>(span.end - block_begin));
+			blocks.push_back({block_begin, block_end, span.segment});
+			block_begin = block_end;
+		}
+	}
+	return blocks;
 }
 
 
@@ -71,142 +481,286 @@ vector<Document> SearchServer::FindTopDocuments(string_view raw_query) const {
 }
 
 
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, const RatingRange& rating_range) const {
+	return FindTopDocuments(execution::seq, raw_query, rating_range, [](int document_id, DocumentStatus document_status, int rating) {
+		return document_status == DocumentStatus::ACTUAL;
+		});
+}
+
+
+SearchPage SearchServer::FindTopDocumentsPage(string_view raw_query, size_t page_size, const SearchCursor& cursor) const {
+	return FindTopDocumentsPage(execution::seq, raw_query, page_size, cursor, [](int document_id, DocumentStatus document_status, int rating) {
+		return document_status == DocumentStatus::ACTUAL;
+		});
+}
+
+
+future<SearchResult> SearchServer::FindTopDocumentsAsync(string_view raw_query, QueryBudget::Clock::time_point deadline,
+                                                         CancellationToken token) const {
+	return FindTopDocumentsAsync(execution::seq, raw_query, deadline, move(token), [](int document_id, DocumentStatus document_status, int rating) {
+		return document_status == DocumentStatus::ACTUAL;
+		});
+}
+
+
+void SearchServer::SetExecutor(Executor executor) {
+	executor_ = move(executor);
+}
+
+void SearchServer::Schedule(function<void()> task) const {
+	if (executor_) {
+		executor_(move(task));
+	}
+	else {
+		thread_pool_->Submit(move(task));
+	}
+}
+
+
+void SearchServer::SetThreadPool(shared_ptr<ThreadPool> thread_pool) {
+	if (!thread_pool) {
+		throw invalid_argument("Thread pool is null"s);
+	}
+	thread_pool_ = move(thread_pool);
+}
+
+ThreadPool& SearchServer::GetThreadPool() const {
+	return *thread_pool_;
+}
+
+
 
 int SearchServer::GetDocumentCount() const {
+	shared_lock lock(index_mutex_);
 	return documents_.size();
 }
 
 
-vector<int>::const_iterator SearchServer::begin() const {
+void SearchServer::SetScoringMode(ScoringMode mode) {
+	scoring_mode_ = mode;
+}
+
+ScoringMode SearchServer::GetScoringMode() const {
+	return scoring_mode_;
+}
+
+double SearchServer::GetImpactQuantum() const {
+	shared_lock lock(index_mutex_);
+	// No IDF exceeds log(N), reached by a term of a single document
+	return documents_.size() > 1 ? log(documents_.size() * 1.0) * IMPACT_TF_QUANTUM : 0.0;
+}
+
+
+MemoryStats SearchServer::GetMemoryStats() const {
+	return memory_counters_.GetStats();
+}
+
+void SearchServer::SetMemoryBudget(size_t bytes) {
+	unique_lock lock(index_mutex_);
+	memory_budget_ = bytes;
+	if (IsOverMemoryBudget()) {
+		InvalidateCaches();
+	}
+}
+
+bool SearchServer::IsOverMemoryBudget() const {
+	return memory_budget_ > 0 && memory_counters_.GetTotal() > memory_budget_;
+}
+
+
+void SearchServer::SetSegmentCapacity(size_t capacity) {
+	if (capacity == 0) {
+		throw invalid_argument("Segment capacity must be positive"s);
+	}
+	unique_lock lock(index_mutex_);
+	segment_capacity_ = capacity;
+	if (mutable_segment_.GetDocumentIds().size() >= segment_capacity_) {
+		SealMutableSegment();
+	}
+}
+
+size_t SearchServer::GetSegmentCount() const {
+	shared_lock lock(index_mutex_);
+	return sealed_segments_.size();
+}
+
+void SearchServer::WaitForMerges() const {
+	unique_lock lock(merge_mutex_);
+	merge_cv_.wait(lock, [this] { return !merge_requested_ && !merging_; });
+}
+
+
+SearchServer::DocumentIds::const_iterator SearchServer::begin() const {
 	return document_ids_.begin();
 }
 
-vector<int>::const_iterator SearchServer::end() const {
+SearchServer::DocumentIds::const_iterator SearchServer::end() const {
 	return document_ids_.end();
 }
 
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-	if (documents_.lower_bound(document_id) == documents_.end()) {
-		const static map<string_view, double> empty_map;
+uint64_t SearchServer::GetWordSetHash(int document_id) const {
+	shared_lock lock(index_mutex_);
+	return documents_.at(document_id).word_set_hash;
+}
+
+
+void SearchServer::SetDuplicatePolicy(DuplicatePolicy policy) {
+	unique_lock lock(index_mutex_);
+	duplicate_policy_ = policy;
+}
+
+
+const SearchServer::WordFrequencies& SearchServer::GetWordFrequencies(int document_id) const {
+	shared_lock lock(index_mutex_);
+	const auto document = documents_.find(document_id);
+	if (document == documents_.end()) {
+		const static MemoryCounters unused_counters;
+		const static WordFrequencies empty_map{CountingAllocator<char>(&unused_counters, MemoryCategory::FORWARD_INDEX)};
 		return empty_map;
 	}
-	return documents_.at(document_id).word_to_freq;
+	return document->second.word_to_freq;
 }
 
 
 void SearchServer::RemoveDocument(int document_id) {
-	if (documents_.lower_bound(document_id) != documents_.end()) {
-		auto it = documents_.lower_bound(document_id)->second.word_to_freq;
-		for(auto word : it) {
-			word_to_document_freqs_[string(word.first)].erase(document_id);
-			if(word_to_document_freqs_[string(word.first)].empty()) {
-				word_to_document_freqs_.erase(string(word.first));
-			}
-		}
-		documents_.erase(document_id);
-		document_ids_.erase(lower_bound(document_ids_.begin(), document_ids_.end(), document_id));
-	}
+	unique_lock lock(index_mutex_);
+	UnindexDocument(document_id);
 }
 
 void SearchServer::RemoveDocument(std::execution::parallel_policy&, int document_id) {
-	if (documents_.lower_bound(document_id) != documents_.end()) {
-		auto it = documents_.lower_bound(document_id)->second.word_to_freq;
-		for_each(/*std::execution::par, */it.begin(), it.end(), [&](const auto& word) {
-																word_to_document_freqs_[string(word.first)].erase(document_id);
-																if(word_to_document_freqs_[string(word.first)].empty()) {
-																	word_to_document_freqs_.erase(string(word.first));
-																} });
-		documents_.erase(document_id);
-		document_ids_.erase(lower_bound(document_ids_.begin(), document_ids_.end(), document_id));
-	}
+	RemoveDocument(document_id);
 }
 
 void SearchServer::RemoveDocument(std::execution::sequenced_policy&, int document_id) {
-	if (documents_.lower_bound(document_id) != documents_.end()) {
-		auto it = documents_.lower_bound(document_id)->second.word_to_freq;
-		for_each(/*std::execution::seq,*/ it.begin(), it.end(), [&](const auto& word) {
-																word_to_document_freqs_[string(word.first)].erase(document_id);
-																if(word_to_document_freqs_[string(word.first)].empty()) {
-																	word_to_document_freqs_.erase(string(word.first));
-																} });
-		documents_.erase(document_id);
-		document_ids_.erase(lower_bound(document_ids_.begin(), document_ids_.end(), document_id));
-	}
+	RemoveDocument(document_id);
 }
 
 
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
+tuple<vector<string>, DocumentStatus> SearchServer::MatchDocument(string_view raw_query, int document_id) const {
 	const Query query = ParseQuery(raw_query);
 	
-	vector<string_view> matched_words;
+	shared_lock lock(index_mutex_);
+	const DocumentData& document_data = documents_.at(document_id);
+	vector<string> matched_words;
 	for (const string_view word : query.plus_words) {
-		if (word_to_document_freqs_.count(string(word)) == 0) {
-			continue;
-		}
-		if (word_to_document_freqs_.at(string(word)).count(document_id)) {
-			matched_words.push_back(word);
+		if (document_data.word_to_freq.count(word)) {
+			matched_words.emplace_back(word);
 		}
 	}
+	for (const string_view prefix : query.plus_prefixes) {
+		const vector<string_view> prefix_words = MatchPrefix(document_data.word_to_freq, prefix);
+		matched_words.insert(matched_words.end(), prefix_words.begin(), prefix_words.end());
+	}
 	for (const string_view word : query.minus_words) {
-		if (word_to_document_freqs_.count(string(word)) == 0) {
-			continue;
+		if (document_data.word_to_freq.count(word)) {
+			matched_words.clear();
+			break;
 		}
-		if (word_to_document_freqs_.at(string(word)).count(document_id)) {
+	}
+	for (const string_view prefix : query.minus_prefixes) {
+		if (!MatchPrefix(document_data.word_to_freq, prefix).empty()) {
 			matched_words.clear();
 			break;
 		}
 	}
-	return {matched_words, documents_.at(document_id).status};
+	return {matched_words, document_data.status};
 }
 
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy, string_view raw_query, int document_id) const {
+tuple<vector<string>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy, string_view raw_query, int document_id) const {
 	const Query query = ParseQuery(raw_query);
 	
-	vector<string_view> matched_words;
-	for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), [&](const string_view word){
-		if (word_to_document_freqs_.count(string(word)) != 0) {
-			if (word_to_document_freqs_.at(string(word)).count(document_id)) {
-				matched_words.push_back(word);
-			}
+	shared_lock lock(index_mutex_);
+	const DocumentData& document_data = documents_.at(document_id);
+	const vector<string_view> minus_words(query.minus_words.begin(), query.minus_words.end());
+	atomic<bool> has_minus_word{false};
+	thread_pool_->ParallelFor(minus_words.size(), [&](size_t i) {
+		if (document_data.word_to_freq.count(minus_words[i]) > 0) {
+			has_minus_word = true;
 		}
 	});
-	for_each(/*std::execution::par,*/ query.minus_words.begin(), query.minus_words.end(), [&](const string_view word){
-		if (word_to_document_freqs_.count(string(word)) != 0) {
-			if (word_to_document_freqs_.at(string(word)).count(document_id)) {
-				matched_words.clear();
-				return ;
-			}
-		}
+	if (has_minus_word || any_of(query.minus_prefixes.begin(), query.minus_prefixes.end(), [&](string_view prefix) {
+		return !MatchPrefix(document_data.word_to_freq, prefix).empty();
+	})) {
+		return {vector<string>(), document_data.status};
+	}
+	
+	vector<string_view> plus_words(query.plus_words.begin(), query.plus_words.end());
+	vector<char> is_matched(plus_words.size());
+	thread_pool_->ParallelFor(plus_words.size(), [&](size_t i) {
+		is_matched[i] = document_data.word_to_freq.count(plus_words[i]) > 0;
 	});
-	return { matched_words, documents_.at(document_id).status };
+	vector<string> matched_words;
+	for (size_t i = 0; i < plus_words.size(); ++i) {
+		if (is_matched[i]) {
+			matched_words.emplace_back(plus_words[i]);
+		}
+	}
+	for (const string_view prefix : query.plus_prefixes) {
+		const vector<string_view> prefix_words = MatchPrefix(document_data.word_to_freq, prefix);
+		matched_words.insert(matched_words.end(), prefix_words.begin(), prefix_words.end());
+	}
+	return {matched_words, document_data.status};
 }
 
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy, string_view raw_query, int document_id) const {
-	const Query query = ParseQuery(raw_query);
-	
-	vector<string_view> matched_words;
-	for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), [&](const string_view word){
-		if (word_to_document_freqs_.count(string(word)) != 0) {
-			if (word_to_document_freqs_.at(string(word)).count(document_id)) {
-				matched_words.push_back(word);
-			}
+tuple<vector<string>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy, string_view raw_query, int document_id) const {
+	return MatchDocument(raw_query, document_id);
+}
+
+
+vector<string_view> SearchServer::MatchPrefix(const WordFrequencies& word_to_freq, string_view prefix) const {
+	const shared_ptr<const PrefixExpansion> prefix_expansion = ExpandPrefix(prefix);
+	const CountedVector<const DictionaryEntry*>& expansion = prefix_expansion->terms;
+	const auto is_expanded = [&expansion](string_view word) {
+		// Below the cap every dictionary term with the prefix is expanded
+		if (expansion.size() < MAX_PREFIX_EXPANSIONS) {
+			return true;
 		}
-	});
-	for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(), [&](const string_view word){
-		if (word_to_document_freqs_.count(string(word)) != 0) {
-			if (word_to_document_freqs_.at(string(word)).count(document_id)) {
-				matched_words.clear();
-				return ;
-			}
+		const auto term = lower_bound(expansion.begin(), expansion.end(), word, [](const DictionaryEntry* lhs, string_view rhs) {
+			return string_view(lhs->first) < rhs;
+		});
+		return term != expansion.end() && string_view((*term)->first) == word;
+	};
+	vector<string_view> words;
+	for (auto word = word_to_freq.lower_bound(prefix); word != word_to_freq.end() && word->first.substr(0, prefix.size()) == prefix; ++word) {
+		if (is_expanded(word->first)) {
+			words.push_back(word->first);
 		}
-	});
-	return {matched_words, documents_.at(document_id).status};
+	}
+	return words;
+}
+
+
+uint64_t SearchServer::HashWordSet(const vector<string_view>& sorted_words) {
+	// FNV-1a with a separator byte between words
+	uint64_t hash = 14695981039346656037ULL;
+	for (const string_view word : sorted_words) {
+		for (const char c : word) {
+			hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+		}
+		hash = (hash ^ static_cast<unsigned char>(' ')) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+
+bool SearchServer::RanksBefore(const Document& lhs, const Document& rhs) {
+	// Relevances within EPSILON of each other may still be told apart, but only by whole buckets,
+	// which keeps the order transitive
+	const long long lhs_bucket = llround(lhs.relevance / EPSILON);
+	const long long rhs_bucket = llround(rhs.relevance / EPSILON);
+	if (lhs_bucket != rhs_bucket) {
+		return lhs_bucket > rhs_bucket;
+	}
+	if (lhs.rating != rhs.rating) {
+		return lhs.rating > rhs.rating;
+	}
+	return lhs.id < rhs.id;
 }
 
 
 bool SearchServer::IsStopWord(string_view word) const {
-	return stop_words_.count(string(word)) > 0;
+	return stop_words_.Contains(word);
 }
 
 
@@ -218,14 +772,14 @@ bool SearchServer::IsValidWord(string_view word) {
 }
 
 
-vector<string> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-	vector<string> words;
+vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
+	vector<string_view> words;
 	for (const string_view word : SplitIntoWords(text)) {
 		if (!IsValidWord(word)) {
 			throw invalid_argument("Word "s + string(word) + " is invalid"s);
 		}
 		if (!IsStopWord(word)) {
-			words.push_back(string(word));
+			words.push_back(word);
 		}
 	}
 	return words;
@@ -254,10 +808,16 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(string_view word) const {
 		is_minus = true;
 		word.remove_prefix(1);
 	}
-	if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+	bool is_prefix = false;
+	if (!word.empty() && word.back() == '*') {
+		is_prefix = true;
+		word.remove_suffix(1);
+	}
+	if (word.empty() || word[0] == '-' || word.find('*') != string_view::npos || !IsValidWord(word)) {
 		throw invalid_argument("Query word "s + string(word) + " is invalid");
 	}
-	return {word, is_minus, IsStopWord(word)};
+	// A prefix is not a stop word even when it spells one
+	return {word, is_minus, !is_prefix && IsStopWord(word), is_prefix};
 }
 
 
@@ -265,7 +825,10 @@ SearchServer::Query SearchServer::ParseQuery(string_view text) const {
 	Query result;
 	for (const string_view word : SplitIntoWords(text)) {
 		const auto query_word = ParseQueryWord(word);
-		if (!query_word.is_stop) {
+		if (query_word.is_prefix) {
+			(query_word.is_minus ? result.minus_prefixes : result.plus_prefixes).insert(query_word.data);
+		}
+		else if (!query_word.is_stop) {
 			if (query_word.is_minus) {
 				result.minus_words.insert(query_word.data);
 			}
@@ -278,12 +841,178 @@ SearchServer::Query SearchServer::ParseQuery(string_view text) const {
 }
 
 
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(const string &word) const {
-	return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeWordInverseDocumentFreq(const TermInfo& term_info) const {
+	{
+		shared_lock lock(cache_mutex_);
+		const auto it = idf_cache_.find(&term_info);
+		if (it != idf_cache_.end()) {
+			return it->second;
+		}
+	}
+	// Document counts are global, so every segment scores with the same IDF
+	const double inverse_document_freq = log(documents_.size() * 1.0 / term_info.document_count);
+	if (!IsOverMemoryBudget()) {
+		unique_lock lock(cache_mutex_);
+		idf_cache_.emplace(&term_info, inverse_document_freq);
+	}
+	return inverse_document_freq;
+}
+
+
+void SearchServer::InvalidateCaches() {
+	unique_lock lock(cache_mutex_);
+	idf_cache_.clear();
+	idf_cache_.rehash(0);
+	prefix_expansion_cache_.clear();
+	prefix_cache_.clear();
+}
+
+
+SearchServer::RatingFilter SearchServer::BuildRatingFilter(const Query& query, const RatingRange* rating_range) const {
+	RatingFilter filter;
+	filter.range_ = rating_range;
+	if (rating_range == nullptr || documents_.empty()) {
+		return filter;
+	}
+	const auto buckets_begin = rating_to_document_ids_.lower_bound(rating_range->min_rating);
+	const auto buckets_end = rating_range->min_rating <= rating_range->max_rating
+	                         ? rating_to_document_ids_.upper_bound(rating_range->max_rating)
+	                         : buckets_begin;
+	size_t range_size = 0;
+	for (auto bucket = buckets_begin; bucket != buckets_end; ++bucket) {
+		range_size += bucket->second.size();
+	}
+	
+	size_t postings_size = 0;
+	for (const string_view word : query.plus_words) {
+		const auto term = word_to_document_freqs_.find(word);
+		if (term != word_to_document_freqs_.end()) {
+			postings_size += term->second.document_count;
+		}
+	}
+	// A document of the range costs a forward index lookup per plus word,
+	// a posting costs a document lookup
+	// Prefix terms are not in the forward index
+	if (query.plus_prefixes.empty() && range_size * query.plus_words.size() < postings_size) {
+		filter.is_filter_first_ = true;
+		filter.range_ids_.reserve(range_size);
+		for (auto bucket = buckets_begin; bucket != buckets_end; ++bucket) {
+			filter.range_ids_.insert(filter.range_ids_.end(), bucket->second.begin(), bucket->second.end());
+		}
+	}
+	else if (range_size <= documents_.size() / 2) {
+		filter.bitset_.resize(documents_.rbegin()->first + 1);
+		for (auto bucket = buckets_begin; bucket != buckets_end; ++bucket) {
+			for (const int document_id : bucket->second) {
+				filter.bitset_[document_id] = true;
+			}
+		}
+	}
+	return filter;
+}
+
+
+bool SearchServer::ExclusionFilter::IsExcluded(int document_id) const {
+	if (!bitset_.empty()) {
+		return static_cast<size_t>(document_id) < bitset_.size() && bitset_[document_id];
+	}
+	if (!sorted_ids_.empty()) {
+		return binary_search(sorted_ids_.begin(), sorted_ids_.end(), document_id);
+	}
+	if (!probe_words_.empty()) {
+		const WordFrequencies& word_to_freq = server_->documents_.at(document_id).word_to_freq;
+		for (const string_view word : probe_words_) {
+			if (word_to_freq.count(word) > 0) {
+				return true;
+			}
+		}
+	}
+	for (const auto& prefix_postings : probe_prefixes_) {
+		const auto& postings = prefix_postings->postings;
+		if (binary_search(postings.begin(), postings.end(), Posting{document_id, 0.0}, [](const Posting& lhs, const Posting& rhs) {
+			return lhs.document_id < rhs.document_id;
+		})) {
+			return true;
+		}
+	}
+	return false;
 }
 
 
+SearchServer::ExclusionFilter SearchServer::BuildExclusionFilter(const Query& query) const {
+	ExclusionFilter filter;
+	vector<string_view> minus_words;
+	vector<PostingSpan> minus_spans;
+	size_t minus_postings_size = 0;
+	for (const string_view word : query.minus_words) {
+		TermPostings term_postings = FindTermPostings(word);
+		if (term_postings.info != nullptr) {
+			minus_words.push_back(word);
+			minus_spans.insert(minus_spans.end(), term_postings.spans.begin(), term_postings.spans.end());
+			minus_postings_size += term_postings.info->document_count;
+		}
+	}
+	vector<shared_ptr<const PrefixPostings>> minus_prefixes;
+	for (const string_view prefix : query.minus_prefixes) {
+		shared_ptr<const PrefixPostings> prefix_postings = GetPrefixPostings(prefix);
+		const auto& postings = prefix_postings->postings;
+		if (!postings.empty()) {
+			minus_spans.push_back({postings.data(), postings.data() + postings.size(), nullptr});
+			minus_postings_size += postings.size();
+			minus_prefixes.push_back(move(prefix_postings));
+		}
+	}
+	if (minus_words.empty() && minus_prefixes.empty()) {
+		return filter;
+	}
+	
+	size_t plus_postings_size = 0;
+	for (const string_view word : query.plus_words) {
+		const auto it = word_to_document_freqs_.find(word);
+		if (it != word_to_document_freqs_.end()) {
+			plus_postings_size += it->second.document_count;
+		}
+	}
+	for (const string_view prefix : query.plus_prefixes) {
+		plus_postings_size += GetPrefixPostings(prefix)->postings.size();
+	}
+	
+	// A minus word more common than all plus words together: materializing it would cost
+	// more than probing the forward index once per scored candidate
+	if (minus_postings_size > plus_postings_size) {
+		filter.server_ = this;
+		filter.probe_words_ = move(minus_words);
+		filter.probe_prefixes_ = move(minus_prefixes);
+		return filter;
+	}
+	
+	// Ids are dense enough for a bitset when it takes no more memory than a sorted id list
+	const int max_document_id = documents_.rbegin()->first;
+	if (static_cast<size_t>(max_document_id) / (sizeof(int) * 8) <= minus_postings_size) {
+		filter.bitset_.resize(max_document_id + 1);
+		for (const PostingSpan& span : minus_spans) {
+			for (const Posting* posting = span.begin; posting != span.end; ++posting) {
+				if (!span.IsDeleted(posting->document_id)) {
+					filter.bitset_[posting->document_id] = true;
+				}
+			}
+		}
+		return filter;
+	}
+	
+	filter.sorted_ids_.reserve(minus_postings_size);
+	for (const PostingSpan& span : minus_spans) {
+		for (const Posting* posting = span.begin; posting != span.end; ++posting) {
+			if (!span.IsDeleted(posting->document_id)) {
+				filter.sorted_ids_.push_back(posting->document_id);
+			}
+		}
+	}
+	sort(filter.sorted_ids_.begin(), filter.sorted_ids_.end());
+	filter.sorted_ids_.erase(unique(filter.sorted_ids_.begin(), filter.sorted_ids_.end()), filter.sorted_ids_.end());
+	return filter;
+}
+
 void AddDocument(SearchServer& search_server, int document_id, const string& document, DocumentStatus status,
                  const vector<int>& ratings) {
 	try {
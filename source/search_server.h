@@ -1,7 +1,13 @@
 #pragma once
 
 #include "document.h"
+#include "index_segment.h"
+#include "mapped_corpus.h"
+#include "memory_stats.h"
+#include "query_budget.h"
+#include "stop_words.h"
 #include "string_processing.h"
+#include "thread_pool.h"
 
 #include <string>
 #include <vector>
@@ -12,9 +18,73 @@
 #include <tuple>
 #include <execution>
 #include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <limits>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 const double EPSILON = 1e-6;
+const size_t POSTING_BLOCK_SIZE = 1024;
+const size_t DEFAULT_SEGMENT_CAPACITY = 4096;
+const size_t SEGMENT_MERGE_FACTOR = 4;
+const size_t MAX_PREFIX_EXPANSIONS = 1024;
+const size_t MAX_CACHED_PREFIXES = 256;
+
+// EXACT scores in double precision. IMPACT scores sealed segments in integers: term frequencies
+// quantised to 16 bits when the segment is built, times the IDFs of the query quantised to
+// IMPACT_MAX_WEIGHT, summed by position in dense arrays. Each relevance then differs from EXACT
+// by at most (number of plus words + 3) * GetImpactQuantum() / 2. Queries with prefix terms or
+// more than IMPACT_MAX_TERMS plus words are scored exactly
+enum class ScoringMode {
+	EXACT,
+	IMPACT,
+};
+
+// The quantised term frequencies of a document add up to at most 65535 plus half a unit per
+// word, so a sum over IMPACT_MAX_TERMS words weighted by up to IMPACT_MAX_WEIGHT fits uint32_t
+const uint32_t IMPACT_MAX_WEIGHT = 1 << 15;
+const size_t IMPACT_MAX_TERMS = 1 << 16;
+
+enum class DuplicatePolicy {
+	ALLOW,
+	REJECT_EXACT, // AddDocument throws for a document with the same word set as an existing one
+};
+
+// Opaque position after the last document of a results page;
+// a default-constructed cursor starts from the top
+class SearchCursor {
+public:
+	SearchCursor() = default;
+
+private:
+	friend class SearchServer;
+	
+	bool is_start_ = true;
+	Document last_;
+};
+
+// Inclusive bounds on the average rating of a document
+struct RatingRange {
+	int min_rating = std::numeric_limits<int>::min();
+	int max_rating = std::numeric_limits<int>::max();
+	
+	bool Contains(int rating) const {
+		return min_rating <= rating && rating <= max_rating;
+	}
+};
+
+struct SearchPage {
+	std::vector<Document> documents;
+	SearchCursor next;     // resumes right after documents.back()
+	bool has_more = false;
+};
 
 namespace std::execution {
 	class parallel_policy;
@@ -23,61 +93,56 @@ namespace std::execution {
 
 class SearchServer {
 public:
+	using WordFrequencies = std::map<std::string_view, double, std::less<std::string_view>,
+	                                 CountingAllocator<std::pair<const std::string_view, double>>>;
+	using DocumentIds = CountedVector<int>;
+
 	template <typename StringContainer>
 	explicit SearchServer(const StringContainer& stop_words)
-			: stop_words_(MakeUniqueNonEmptyStrings(stop_words))  // Extract non-empty stop words
+			: stop_words_(stop_words)  // Copy non-empty stop words
 	{
-		if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
+		const std::vector<std::string_view> words = stop_words_.GetWords();
+		if (!all_of(words.begin(), words.end(), IsValidWord)) {
 			throw std::invalid_argument("Some of stop words are invalid");
 		}
 	}
 	
+	// Stop words hashed at compile time, see MakeStopWords
+	template <size_t N>
+	explicit SearchServer(const StaticStopWords<N>& stop_words)
+			: stop_words_(stop_words)
+	{}
+	
 	explicit SearchServer(const std::string& stop_words_text);
 	explicit SearchServer(std::string_view stop_words_text);
+	
+	// The background merge thread and the locks readers hold refer to this object, so a server
+	// can be neither copied nor moved; keep it in place or behind a pointer
+	SearchServer(const SearchServer&) = delete;
+	SearchServer& operator=(const SearchServer&) = delete;
+	
+	// Waits for the segment merge in progress
+	~SearchServer();
 
 	
 	void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 	
+	// Adds every non-empty document of the corpus under consecutive ids starting from first_document_id
+	// and returns their number. Texts stay views into the mapping, which the server keeps alive
+	int AddDocuments(std::shared_ptr<const MappedCorpus> corpus, int first_document_id, DocumentStatus status,
+	                 const std::vector<int>& ratings);
+	
 	
 	template <typename DocumentPredicate>
 	std::vector<Document> FindTopDocuments(const std::execution::parallel_policy& ,std::string_view raw_query, const DocumentPredicate& document_predicate) const {
 		const Query query = ParseQuery(raw_query);
-
-		std::vector<Document> matched_documents = FindAllDocuments(std::execution::par, query, document_predicate);
-
-		sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-			if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-				return lhs.rating > rhs.rating;
-			}
-			else {
-				return lhs.relevance > rhs.relevance;
-			}
-			});
-		if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-			matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-		}
-		return matched_documents;
+		return FindTopDocumentsByQuery(std::execution::par, query, document_predicate);
 	}
 	
 	template <typename DocumentPredicate>
 	std::vector<Document> FindTopDocuments(const std::execution::sequenced_policy&, std::string_view raw_query, const DocumentPredicate& document_predicate) const {
 		const Query query = ParseQuery(raw_query);
-
-		std::vector<Document> matched_documents = FindAllDocuments(std::execution::seq, query, document_predicate);
-
-		sort(matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-			if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-				return lhs.rating > rhs.rating;
-			}
-			else {
-				return lhs.relevance > rhs.relevance;
-			}
-			});
-		if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-			matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-		}
-
-		return matched_documents;
+		return FindTopDocumentsByQuery(std::execution::seq, query, document_predicate);
 	}
 	
 	template <typename DocumentPredicate>
@@ -94,16 +159,173 @@ public:
 	std::vector<Document> FindTopDocuments(std::execution::parallel_policy& ,std::string_view raw_query) const;
 	std::vector<Document> FindTopDocuments(std::execution::sequenced_policy&, std::string_view raw_query) const;
 	std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
+
+	
+	// Keeps the documents rated within the range. Depending on how many documents the range holds,
+	// only they are scored (filter-first) or ratings are checked while scanning postings (score-first)
+	template <typename ExecutionPolicy, typename DocumentPredicate>
+	std::vector<Document> FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const RatingRange& rating_range,
+	                                       const DocumentPredicate& document_predicate) const {
+		const Query query = ParseQuery(raw_query);
+		return FindTopDocumentsByQuery(policy, query, document_predicate, nullptr, &rating_range);
+	}
+	
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, const RatingRange& rating_range) const;
+
+	
+	// Returns up to page_size documents ranked right after the cursor, keeping only a
+	// bounded top-K of the hits below the cursor instead of sorting every match
+	template <typename ExecutionPolicy, typename DocumentPredicate>
+	SearchPage FindTopDocumentsPage(const ExecutionPolicy& policy, std::string_view raw_query, size_t page_size,
+	                                const SearchCursor& cursor, const DocumentPredicate& document_predicate) const {
+		if (page_size == 0) {
+			throw std::invalid_argument("Page size must be positive");
+		}
+		const Query query = ParseQuery(raw_query);
+		const std::vector<Document> matched_documents = FindAllDocuments(policy, query, document_predicate);
+		
+		// Max-heap by rank, so its top is the worst document kept so far
+		std::vector<Document> page;
+		page.reserve(page_size + 1);
+		size_t remaining_count = 0;
+		for (const Document& document : matched_documents) {
+			if (!cursor.is_start_ && !RanksBefore(cursor.last_, document)) {
+				continue;
+			}
+			++remaining_count;
+			if (page.size() < page_size) {
+				page.push_back(document);
+				std::push_heap(page.begin(), page.end(), RanksBefore);
+			}
+			else if (RanksBefore(document, page.front())) {
+				std::pop_heap(page.begin(), page.end(), RanksBefore);
+				page.back() = document;
+				std::push_heap(page.begin(), page.end(), RanksBefore);
+			}
+		}
+		std::sort_heap(page.begin(), page.end(), RanksBefore);
+		
+		SearchPage result;
+		result.has_more = remaining_count > page.size();
+		result.next = cursor;
+		if (!page.empty()) {
+			result.next.is_start_ = false;
+			result.next.last_ = page.back();
+		}
+		result.documents = std::move(page);
+		return result;
+	}
+	
+	SearchPage FindTopDocumentsPage(std::string_view raw_query, size_t page_size, const SearchCursor& cursor = SearchCursor()) const;
+
+	
+	// Stops between posting blocks once the budget runs out and returns the best documents found so far
+	template <typename ExecutionPolicy, typename DocumentPredicate>
+	SearchResult FindTopDocuments(const ExecutionPolicy& policy, std::string_view raw_query, const QueryBudget& budget,
+	                              const DocumentPredicate& document_predicate) const {
+		const Query query = ParseQuery(raw_query);
+		SearchResult result;
+		result.documents = FindTopDocumentsByQuery(policy, query, document_predicate, &budget);
+		result.is_partial = budget.IsExhausted();
+		return result;
+	}
+
+	
+	// Runs a budgeted search on the executor and hands its result to the callback, which suits
+	// wrapping in a coroutine awaiter. Invalid queries throw here, before anything is scheduled;
+	// an exception thrown by the search itself reaches the callback as SearchResult::error
+	template <typename ExecutionPolicy, typename DocumentPredicate, typename Callback>
+	void FindTopDocumentsAsync(const ExecutionPolicy& policy, std::string_view raw_query, QueryBudget::Clock::time_point deadline,
+	                           CancellationToken token, const DocumentPredicate& document_predicate, Callback callback) const {
+		auto query_text = std::make_shared<const std::string>(raw_query);
+		auto query = std::make_shared<const Query>(ParseQuery(*query_text));
+		Schedule([this, policy, query_text, query, deadline, token, document_predicate, callback]() {
+			const QueryBudget budget(deadline, token);
+			SearchResult result;
+			try {
+				result.documents = FindTopDocumentsByQuery(policy, *query, document_predicate, &budget);
+				result.is_partial = budget.IsExhausted();
+			} catch (...) {
+				result = SearchResult();
+				result.error = std::current_exception();
+			}
+			callback(std::move(result));
+		});
+	}
+	
+	template <typename ExecutionPolicy, typename DocumentPredicate>
+	std::future<SearchResult> FindTopDocumentsAsync(const ExecutionPolicy& policy, std::string_view raw_query, QueryBudget::Clock::time_point deadline,
+	                                                CancellationToken token, const DocumentPredicate& document_predicate) const {
+		auto promise = std::make_shared<std::promise<SearchResult>>();
+		std::future<SearchResult> result = promise->get_future();
+		FindTopDocumentsAsync(policy, raw_query, deadline, std::move(token), document_predicate, [promise](SearchResult found) {
+			if (found.error) {
+				promise->set_exception(found.error);
+			}
+			else {
+				promise->set_value(std::move(found));
+			}
+		});
+		return result;
+	}
+	
+	std::future<SearchResult> FindTopDocumentsAsync(std::string_view raw_query, QueryBudget::Clock::time_point deadline,
+	                                                CancellationToken token = CancellationToken()) const;
+
+	
+	// Schedules asynchronous searches; the server must outlive every search it schedules.
+	// By default searches are submitted to the thread pool
+	using Executor = std::function<void(std::function<void()>)>;
+	void SetExecutor(Executor executor);
+	
+	
+	// Runs the parallel overloads and, without an executor, asynchronous searches.
+	// ThreadPool::GetDefault() unless set; not to be changed while searches are running
+	void SetThreadPool(std::shared_ptr<ThreadPool> thread_pool);
+	ThreadPool& GetThreadPool() const;
 	
 	
 	int GetDocumentCount() const;
 
+	
+	void SetScoringMode(ScoringMode mode);
+	ScoringMode GetScoringMode() const;
+	double GetImpactQuantum() const;
+
+	
+	// Heap bytes held by the index, as counted by the allocators of its containers
+	MemoryStats GetMemoryStats() const;
+	
+	// Zero lifts the limit. Over the budget caches are dropped and not refilled,
+	// and adding a document that does not fit undoes it and throws std::length_error
+	void SetMemoryBudget(size_t bytes);
+
+	
+	// New documents go to a mutable segment, which is sealed into an immutable one once it holds
+	// capacity documents. Sealed segments of similar live size are merged SEGMENT_MERGE_FACTOR
+	// at a time on a background thread
+	void SetSegmentCapacity(size_t capacity);
+	
+	// Number of sealed segments
+	size_t GetSegmentCount() const;
+	
+	// Blocks until the background thread has no merge left to do
+	void WaitForMerges() const;
+
 public:
-	std::vector<int>::const_iterator begin() const;
-	std::vector<int>::const_iterator end() const;
+	// Unlike searches, the iterators and the word frequencies below refer into the index without
+	// holding a lock: a concurrent AddDocument or RemoveDocument invalidates them, so use them only
+	// while no document is added or removed
+	DocumentIds::const_iterator begin() const;
+	DocumentIds::const_iterator end() const;
 
 	
-	const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+	const WordFrequencies& GetWordFrequencies(int document_id) const;
+	
+	// Documents with equal sets of non-stop words have equal hashes
+	uint64_t GetWordSetHash(int document_id) const;
+	
+	void SetDuplicatePolicy(DuplicatePolicy policy);
 
 	
 	void RemoveDocument(int document_id);
@@ -111,22 +333,106 @@ public:
 	void RemoveDocument(std::execution::sequenced_policy&, int document_id);
 
 	
-	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
-	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy, std::string_view raw_query, int document_id) const;
-	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy, std::string_view raw_query, int document_id) const;
+	// Words are copied: the dictionary words a prefix matched may be erased by a later RemoveDocument
+	std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+	std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(std::execution::parallel_policy, std::string_view raw_query, int document_id) const;
+	std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(std::execution::sequenced_policy, std::string_view raw_query, int document_id) const;
 
 private:
+	struct TermInfo {
+		int document_count = 0;
+	};
+	using Dictionary = std::map<CountedString, TermInfo, std::less<>, CountingAllocator<std::pair<const CountedString, TermInfo>>>;
+	using DictionaryEntry = Dictionary::value_type;
+
+	
 	struct DocumentData {
-		int rating;
-		DocumentStatus status;
-		std::map<std::string_view, double> word_to_freq;
-		std::set<std::string> words;
-		std::string text;
+		explicit DocumentData(const MemoryCounters* counters);
+		
+		int rating = 0;
+		DocumentStatus status = DocumentStatus::ACTUAL;
+		WordFrequencies word_to_freq; // keys view the term dictionary
+		std::string_view text;
+		CountedString owned_text; // empty when text views a mapped corpus
+		uint64_t word_set_hash = 0;
+		bool in_mutable_segment = true;
+	};
+	
+	// Declared first so that it outlives every container charging it
+	MemoryCounters memory_counters_;
+	size_t memory_budget_ = 0;
+	const StopWordFilter stop_words_;
+	Dictionary word_to_document_freqs_ = Dictionary(MakeAllocator(MemoryCategory::TERM_DICTIONARY)); // слово - число документов по всем сегментам
+	MutableSegment mutable_segment_{&memory_counters_}; // terms view the dictionary
+	std::vector<std::shared_ptr<IndexSegment>> sealed_segments_;
+	size_t segment_capacity_ = DEFAULT_SEGMENT_CAPACITY;
+	std::map<int, DocumentData, std::less<int>, CountingAllocator<std::pair<const int, DocumentData>>> documents_{
+		MakeAllocator(MemoryCategory::DOCUMENT_ATTRIBUTES)};
+	DocumentIds document_ids_ = DocumentIds(MakeAllocator(MemoryCategory::DOCUMENT_ATTRIBUTES));
+	std::vector<std::shared_ptr<const MappedCorpus>> corpora_;
+	std::unordered_multimap<uint64_t, int, std::hash<uint64_t>, std::equal_to<uint64_t>,
+	                        CountingAllocator<std::pair<const uint64_t, int>>> word_set_hash_to_document_ids_{
+		0, std::hash<uint64_t>(), std::equal_to<uint64_t>(), MakeAllocator(MemoryCategory::DOCUMENT_ATTRIBUTES)};
+	// Rating - ids of the documents with it, sorted; kept up to date by every write
+	std::map<int, CountedVector<int>, std::less<int>, CountingAllocator<std::pair<const int, CountedVector<int>>>> rating_to_document_ids_{
+		MakeAllocator(MemoryCategory::DOCUMENT_ATTRIBUTES)};
+	DuplicatePolicy duplicate_policy_ = DuplicatePolicy::ALLOW;
+	std::atomic<ScoringMode> scoring_mode_{ScoringMode::EXACT};
+	Executor executor_;
+	std::shared_ptr<ThreadPool> thread_pool_ = ThreadPool::GetDefault();
+	
+	// Guards the index against writers; taken before cache_mutex_
+	mutable std::shared_mutex index_mutex_;
+
+	
+	// Dictionary terms a prefix expands to, sorted
+	struct PrefixExpansion {
+		explicit PrefixExpansion(const CountingAllocator<char>& allocator);
+		
+		CountedVector<const DictionaryEntry*> terms;
 	};
-	const std::set<std::string_view> stop_words_;
-	std::map<std::string, std::map<int, double>> word_to_document_freqs_; //слово - id - частота
-	std::map<int, DocumentData> documents_;
-	std::vector<int> document_ids_;
+
+	
+	// A prefix is scored as one term: the union of the postings of its expansion, term
+	// frequencies summed per document, with the size of the union as its document count
+	struct PrefixPostings {
+		explicit PrefixPostings(const CountingAllocator<char>& allocator);
+		
+		CountedVector<Posting> postings; // by id, deleted documents dropped
+	};
+
+	
+	// Derived from the index on first use and dropped by every modification
+	mutable std::shared_mutex cache_mutex_;
+	mutable std::unordered_map<const TermInfo*, double, std::hash<const TermInfo*>, std::equal_to<const TermInfo*>,
+	                           CountingAllocator<std::pair<const TermInfo* const, double>>> idf_cache_{
+		0, std::hash<const TermInfo*>(), std::equal_to<const TermInfo*>(), MakeAllocator(MemoryCategory::CACHES)};
+	// The recent prefixes; each cleared when full
+	mutable std::map<CountedString, std::shared_ptr<const PrefixExpansion>, std::less<>,
+	                 CountingAllocator<std::pair<const CountedString, std::shared_ptr<const PrefixExpansion>>>> prefix_expansion_cache_{
+		MakeAllocator(MemoryCategory::CACHES)};
+	mutable std::map<CountedString, std::shared_ptr<const PrefixPostings>, std::less<>,
+	                 CountingAllocator<std::pair<const CountedString, std::shared_ptr<const PrefixPostings>>>> prefix_cache_{
+		MakeAllocator(MemoryCategory::CACHES)};
+
+	
+	mutable std::mutex merge_mutex_;
+	mutable std::condition_variable merge_cv_;
+	bool merge_requested_ = false;
+	bool merging_ = false;
+	std::atomic<bool> stopping_{false};
+	std::thread merge_thread_; // started by the first seal
+
+	
+	CountingAllocator<char> MakeAllocator(MemoryCategory category) const {
+		return {&memory_counters_, category};
+	}
+
+	
+	bool IsOverMemoryBudget() const;
+
+	
+	void InvalidateCaches();
 
 	
 	bool IsStopWord(std::string_view word) const;
@@ -135,16 +441,62 @@ private:
 	static bool IsValidWord(std::string_view word);
 
 	
-	std::vector<std::string> SplitIntoWordsNoStop(std::string_view text) const;
+	std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+
+	
+	// text must outlive the document. The caller holds index_mutex_ exclusively
+	void IndexDocument(int document_id, std::string_view text, DocumentStatus status, const std::vector<int>& ratings);
+
+	
+	// Removes the document from its segment and the dictionary. The caller holds index_mutex_ exclusively
+	void UnindexDocument(int document_id);
+
+	
+	void SealMutableSegment();
+
+	
+	void RunMerges();
+
+	
+	// Merges one group of segments of the same size tier; false when no tier has enough segments
+	bool MergeSegmentsOnce();
+
+	
+	// Postings of a term in every segment, deleted ones included
+	struct TermPostings {
+		const TermInfo* info = nullptr;
+		std::vector<PostingSpan> spans;
+	};
+
+	
+	TermPostings FindTermPostings(std::string_view word) const;
+	TermPostings FindTermPostings(const DictionaryEntry& term) const;
+
+	
+	// Dictionary terms starting with prefix. Of more than MAX_PREFIX_EXPANSIONS terms only that
+	// many of the most frequent ones are kept, in a bounded heap while walking the dictionary
+	std::shared_ptr<const PrefixExpansion> ExpandPrefix(std::string_view prefix) const;
+
+	
+	std::shared_ptr<const PrefixPostings> GetPrefixPostings(std::string_view prefix) const;
+
+	
+	// Words of a document that the prefix expands to
+	std::vector<std::string_view> MatchPrefix(const WordFrequencies& word_to_freq, std::string_view prefix) const;
+
+	
+	// Splits spans into blocks of at most POSTING_BLOCK_SIZE postings
+	static std::vector<PostingSpan> SplitIntoBlocks(const std::vector<PostingSpan>& spans);
 
 	
 	static int ComputeAverageRating(const std::vector<int>& ratings);
 
 	
 	struct QueryWord {
-		std::string_view data;
+		std::string_view data; // without the asterisk of a prefix
 		bool is_minus;
 		bool is_stop;
+		bool is_prefix;
 	};
 
 	
@@ -154,80 +506,416 @@ private:
 	struct Query {
 		std::set<std::string_view> plus_words;
 		std::set<std::string_view> minus_words;
+		std::set<std::string_view> plus_prefixes;
+		std::set<std::string_view> minus_prefixes;
 	};
 
 	
+	// Plus word or prefix of a query with its postings in every segment
+	struct ScoredTerm {
+		double inverse_document_freq = 0.0;
+		std::vector<PostingSpan> spans;
+		std::shared_ptr<const PrefixPostings> prefix_postings; // keeps the spans of a prefix alive
+	};
+
+	
+	std::vector<ScoredTerm> ResolvePlusTerms(const Query& query) const;
+
+	
+	// Whether the query is scored from impacts; read once per query as the mode may change meanwhile
+	bool IsImpactScored(const Query& query) const;
+
+	
+	// IDFs of a query quantised against the largest of them: a unit of weight times impact is
+	// worth scale relevance
+	struct ImpactWeights {
+		std::vector<uint32_t> weights;
+		double scale = 0.0;
+	};
+
+	
+	static ImpactWeights QuantizeWeights(const std::vector<double>& inverse_document_freqs);
+
+	
+	// Per-thread accumulators of FindAllDocumentsByImpact, grown to the largest segment scored and
+	// all zero between queries, so that a query only touches the ordinals of its postings
+	struct ImpactScratch {
+		std::vector<uint32_t> sums;
+		std::vector<char> is_collected;
+	};
+
+	
+	static ImpactScratch& GetImpactScratch();
+
+	
 	Query ParseQuery(std::string_view text) const;
 
 	
-	// Existence required
-	double ComputeWordInverseDocumentFreq(const std::string& word) const;
+	double ComputeWordInverseDocumentFreq(const TermInfo& term_info) const;
+
+	
+	void Schedule(std::function<void()> task) const;
+
+	
+	static uint64_t HashWordSet(const std::vector<std::string_view>& sorted_words);
+
+	
+	// Result order: relevance rounded to a multiple of EPSILON, then rating, then id. A strict weak
+	// ordering, so the cursor of a page compares consistently with the sort and pages never overlap
+	static bool RanksBefore(const Document& lhs, const Document& rhs);
+
+	
+	static bool IsWithinBudget(const QueryBudget* budget) {
+		return budget == nullptr || budget->Check();
+	}
 
 	
+	template <typename ExecutionPolicy, typename DocumentPredicate>
+	std::vector<Document> FindTopDocumentsByQuery(const ExecutionPolicy& policy, const Query& query, const DocumentPredicate& document_predicate,
+	                                              const QueryBudget* budget = nullptr, const RatingRange* rating_range = nullptr) const {
+		std::vector<Document> matched_documents = FindAllDocuments(policy, query, document_predicate, budget, rating_range);
+
+		sort(matched_documents.begin(), matched_documents.end(), RanksBefore);
+		if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+			matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+		}
+		return matched_documents;
+	}
+
+	
+	// Documents excluded by the minus words of a query, resolved before scoring.
+	// Picks the cheapest strategy from the posting-list lengths:
+	// a bitset over dense ids, a sorted id list, or probing minus postings per candidate
+	class ExclusionFilter {
+	public:
+		bool IsExcluded(int document_id) const;
+
+	private:
+		friend class SearchServer;
+
+		std::vector<bool> bitset_;
+		std::vector<int> sorted_ids_;
+		const SearchServer* server_ = nullptr;
+		std::vector<std::string_view> probe_words_; // looked up in the forward index
+		std::vector<std::shared_ptr<const PrefixPostings>> probe_prefixes_;
+	};
+
+	
+	ExclusionFilter BuildExclusionFilter(const Query& query) const;
+
+	
+	// Rating range of a query resolved against the rating index. Filter-first when scoring the
+	// documents of the range through the forward index costs less than scanning the postings.
+	// Otherwise postings are scored, skipping ids outside a bitset of the range when it keeps
+	// at most half of the documents, and checking the rating of the rest
+	class RatingFilter {
+	public:
+		bool IsCandidate(int document_id) const {
+			return bitset_.empty() || (static_cast<size_t>(document_id) < bitset_.size() && bitset_[document_id]);
+		}
+		
+		bool Admits(int rating) const {
+			return range_ == nullptr || range_->Contains(rating);
+		}
+
+	private:
+		friend class SearchServer;
+
+		const RatingRange* range_ = nullptr;
+		bool is_filter_first_ = false;
+		std::vector<int> range_ids_; // filter-first only
+		std::vector<bool> bitset_;
+	};
+
+	
+	// The caller holds index_mutex_
+	RatingFilter BuildRatingFilter(const Query& query, const RatingRange* rating_range) const;
+
+	
+	// Scores the documents of a filter-first range, looking plus words up in their forward index.
+	// With is_impact documents of sealed segments are scored from quantised term frequencies and
+	// weights as in FindAllDocumentsByImpact, so both give identical relevances
 	template <typename DocumentPredicate>
-	std::vector<Document> FindAllDocuments(std::execution::parallel_policy, const Query& query, const DocumentPredicate& document_predicate) const {
-		std::map<int, double> document_to_relevance;
+	std::vector<Document> FindAllDocumentsInRange(bool is_parallel, bool is_impact, const RatingFilter& rating_filter, const Query& query,
+	                                              const DocumentPredicate& document_predicate, const QueryBudget* budget) const {
+		const ExclusionFilter exclusion = BuildExclusionFilter(query);
+		std::vector<std::string_view> plus_terms;
+		std::vector<double> inverse_document_freqs;
 		for (const std::string_view word : query.plus_words) {
-			if (word_to_document_freqs_.count(std::string(word)) == 0) {
-				continue;
+			const auto term = word_to_document_freqs_.find(word);
+			if (term != word_to_document_freqs_.end()) {
+				plus_terms.push_back(word);
+				inverse_document_freqs.push_back(ComputeWordInverseDocumentFreq(term->second));
 			}
-			const double inverse_document_freq = ComputeWordInverseDocumentFreq(std::string(word));
-
-			for_each(std::execution::par, word_to_document_freqs_.at(std::string(word)).begin(),
-					 word_to_document_freqs_.at(std::string(word)).end(), [&](const auto to_document_freqs) {
-				int document_id = to_document_freqs.first;
-				double term_freq = to_document_freqs.second;
-				const auto& document_data = documents_.at(document_id);
-				if (document_predicate(document_id, document_data.status, document_data.rating)) {
-					if(document_to_relevance.count(document_id) == 0) {
-						document_to_relevance[document_id] = 0.0;
+		}
+		const ImpactWeights impact_weights = is_impact ? QuantizeWeights(inverse_document_freqs) : ImpactWeights();
+		
+		const std::vector<int>& range_ids = rating_filter.range_ids_;
+		const size_t range_size = range_ids.size();
+		std::vector<std::vector<Document>> block_documents((range_size + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE);
+		const auto score_block = [&](size_t block) {
+			if (!IsWithinBudget(budget)) {
+				return;
+			}
+			const int* block_end = range_ids.data() + std::min(range_size, (block + 1) * POSTING_BLOCK_SIZE);
+			for (const int* document_id = range_ids.data() + block * POSTING_BLOCK_SIZE; document_id != block_end; ++document_id) {
+				if (exclusion.IsExcluded(*document_id)) {
+					continue;
+				}
+				const auto& document_data = documents_.at(*document_id);
+				const bool is_quantised = is_impact && !document_data.in_mutable_segment;
+				double relevance = 0.0;
+				uint32_t impact_sum = 0;
+				bool is_matched = false;
+				for (size_t term = 0; term < plus_terms.size(); ++term) {
+					const auto term_freq = document_data.word_to_freq.find(plus_terms[term]);
+					if (term_freq == document_data.word_to_freq.end()) {
+						continue;
 					}
-					std::mutex mtx;
-					std::lock_guard<std::mutex> guard(mtx);
-					document_to_relevance[document_id] += term_freq * inverse_document_freq;
+					if (is_quantised) {
+						impact_sum += impact_weights.weights[term] * QuantizeTermFreq(term_freq->second);
+					}
+					else {
+						relevance += term_freq->second * inverse_document_freqs[term];
+					}
+					is_matched = true;
 				}
-			} );
+				if (is_quantised) {
+					relevance = impact_sum * impact_weights.scale;
+				}
+				if (is_matched && document_predicate(*document_id, document_data.status, document_data.rating)) {
+					block_documents[block].push_back({*document_id, relevance, document_data.rating});
+				}
+			}
+		};
+		if (is_parallel) {
+			thread_pool_->ParallelFor(block_documents.size(), score_block);
+		}
+		else {
+			for (size_t block = 0; block < block_documents.size(); ++block) {
+				score_block(block);
+			}
 		}
 		
-		for (const std::string_view word : query.minus_words) {
-			if (word_to_document_freqs_.count(std::string(word)) != 0) {
+		std::vector<Document> matched_documents;
+		for (const std::vector<Document>& documents : block_documents) {
+			matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+		}
+		return matched_documents;
+	}
 
-				for (const auto [document_id, _] : word_to_document_freqs_.at(std::string(word))) {
-					document_to_relevance.erase(document_id);
+	
+	// Sealed segments sum weighted impacts into a dense integer array by ordinal, one segment
+	// per task. The mutable segment has no impacts and is scored exactly
+	template <typename DocumentPredicate>
+	std::vector<Document> FindAllDocumentsByImpact(bool is_parallel, const Query& query, const DocumentPredicate& document_predicate,
+	                                               const QueryBudget* budget, const RatingFilter& rating_filter) const {
+		const ExclusionFilter exclusion = BuildExclusionFilter(query);
+		const std::vector<ScoredTerm> terms = ResolvePlusTerms(query);
+		std::vector<double> inverse_document_freqs;
+		for (const ScoredTerm& term : terms) {
+			inverse_document_freqs.push_back(term.inverse_document_freq);
+		}
+		const ImpactWeights impact_weights = QuantizeWeights(inverse_document_freqs);
+		const auto add_if_matched = [&](int document_id, double relevance, std::vector<Document>& documents) {
+			if (exclusion.IsExcluded(document_id) || !rating_filter.IsCandidate(document_id)) {
+				return;
+			}
+			const auto& document_data = documents_.at(document_id);
+			if (rating_filter.Admits(document_data.rating) && document_predicate(document_id, document_data.status, document_data.rating)) {
+				documents.push_back({document_id, relevance, document_data.rating});
+			}
+		};
+		
+		std::vector<std::vector<Document>> segment_documents(sealed_segments_.size() + 1);
+		const auto score_segment = [&](size_t segment_index) {
+			std::vector<Document>& documents = segment_documents[segment_index];
+			if (segment_index == sealed_segments_.size()) {
+				std::map<int, double> document_to_relevance;
+				for (const ScoredTerm& term : terms) {
+					if (!IsWithinBudget(budget)) {
+						break;
+					}
+					for (const PostingSpan& span : term.spans) {
+						for (const Posting* posting = span.begin; span.segment == nullptr && posting != span.end; ++posting) {
+							document_to_relevance[posting->document_id] += posting->term_freq * term.inverse_document_freq;
+						}
+					}
+				}
+				for (const auto [document_id, relevance] : document_to_relevance) {
+					add_if_matched(document_id, relevance, documents);
 				}
+				return;
 			}
+			
+			const IndexSegment& segment = *sealed_segments_[segment_index];
+			// Postings of each term in the segment and how many of them were summed
+			std::vector<std::tuple<const PostingSpan*, uint32_t, size_t>> segment_spans;
+			size_t posting_count = 0;
+			for (size_t term = 0; term < terms.size(); ++term) {
+				const auto span = std::find_if(terms[term].spans.begin(), terms[term].spans.end(), [&segment](const PostingSpan& span) {
+					return span.segment == &segment;
+				});
+				if (span != terms[term].spans.end()) {
+					segment_spans.push_back({&*span, impact_weights.weights[term], 0});
+					posting_count += span->size();
+				}
+			}
+			if (segment_spans.empty()) {
+				return;
+			}
+			// Allocated before the scratch is touched, so that nothing can throw until it is zeroed again
+			std::vector<std::pair<uint32_t, uint32_t>> hits; // ordinal - weighted impact sum
+			hits.reserve(posting_count);
+			ImpactScratch& scratch = GetImpactScratch();
+			if (scratch.sums.size() < segment.GetDocumentIds().size()) {
+				scratch.sums.resize(segment.GetDocumentIds().size());
+				scratch.is_collected.resize(segment.GetDocumentIds().size());
+			}
+			
+			uint32_t* const sums = scratch.sums.data();
+			for (auto& [span, weight, summed_size] : segment_spans) {
+				if (!IsWithinBudget(budget)) {
+					break;
+				}
+				const uint32_t* ordinals = segment.GetOrdinals(*span);
+				const uint16_t* impacts = segment.GetImpacts(*span);
+				for (size_t block = 0; block < span->size(); block += POSTING_BLOCK_SIZE) {
+					if (block > 0 && !IsWithinBudget(budget)) {
+						break;
+					}
+					const size_t block_end = std::min(block + POSTING_BLOCK_SIZE, span->size());
+					for (size_t i = block; i < block_end; ++i) {
+						sums[ordinals[i]] += weight * impacts[i];
+					}
+					summed_size = block_end;
+				}
+			}
+			
+			for (const auto& [span, weight, summed_size] : segment_spans) {
+				const uint32_t* ordinals = segment.GetOrdinals(*span);
+				for (size_t i = 0; i < summed_size; ++i) {
+					if (!scratch.is_collected[ordinals[i]]) {
+						scratch.is_collected[ordinals[i]] = true;
+						hits.push_back({ordinals[i], sums[ordinals[i]]});
+						sums[ordinals[i]] = 0;
+					}
+				}
+			}
+			for (const auto& [ordinal, _] : hits) {
+				scratch.is_collected[ordinal] = false;
+			}
+			
+			for (const auto& [ordinal, impact_sum] : hits) {
+				const int document_id = segment.GetDocumentIds()[ordinal];
+				if (!segment.IsDeleted(document_id)) {
+					add_if_matched(document_id, impact_sum * impact_weights.scale, documents);
+				}
+			}
+		};
+		if (is_parallel) {
+			thread_pool_->ParallelFor(segment_documents.size(), score_segment);
 		}
+		else {
+			for (size_t segment_index = 0; segment_index < segment_documents.size(); ++segment_index) {
+				score_segment(segment_index);
+			}
+		}
+		
 		std::vector<Document> matched_documents;
-		for (const auto [document_id, relevance] : document_to_relevance) {
-			matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+		for (const std::vector<Document>& documents : segment_documents) {
+			matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
 		}
 		return matched_documents;
 	}
 
+	
 	template <typename DocumentPredicate>
-	std::vector<Document> FindAllDocuments(std::execution::sequenced_policy, const Query& query, const DocumentPredicate& document_predicate) const {
+	std::vector<Document> FindAllDocuments(std::execution::parallel_policy, const Query& query, const DocumentPredicate& document_predicate,
+	                                       const QueryBudget* budget = nullptr, const RatingRange* rating_range = nullptr) const {
+		std::shared_lock index_lock(index_mutex_);
+		const RatingFilter rating_filter = BuildRatingFilter(query, rating_range);
+		const bool is_impact = IsImpactScored(query);
+		if (rating_filter.is_filter_first_) {
+			return FindAllDocumentsInRange(true, is_impact, rating_filter, query, document_predicate, budget);
+		}
+		if (is_impact) {
+			return FindAllDocumentsByImpact(true, query, document_predicate, budget, rating_filter);
+		}
+		const ExclusionFilter exclusion = BuildExclusionFilter(query);
 		std::map<int, double> document_to_relevance;
-		for (const std::string_view word : query.plus_words) {
-			if (word_to_document_freqs_.count(std::string(word)) == 0) {
-				continue;
+		std::mutex mtx;
+		for (const ScoredTerm& term : ResolvePlusTerms(query)) {
+			if (!IsWithinBudget(budget)) {
+				break;
 			}
-			const double inverse_document_freq = ComputeWordInverseDocumentFreq(std::string(word));
-			for (const auto [document_id, term_freq] : word_to_document_freqs_.at(std::string(word))) {
-				const auto& document_data = documents_.at(document_id);
-				if (document_predicate(document_id, document_data.status, document_data.rating)) {
-					if (document_to_relevance.count(document_id) == 0) {
-						document_to_relevance[document_id] = 0.0;
+			const double inverse_document_freq = term.inverse_document_freq;
+			const std::vector<PostingSpan> blocks = SplitIntoBlocks(term.spans);
+
+			thread_pool_->ParallelFor(blocks.size(), [&](size_t block_index) {
+				if (!IsWithinBudget(budget)) {
+					return;
+				}
+				const PostingSpan& block = blocks[block_index];
+				std::vector<std::pair<int, double>> block_relevance;
+				for (const Posting* posting = block.begin; posting != block.end; ++posting) {
+					const auto [document_id, term_freq] = *posting;
+					if (block.IsDeleted(document_id) || exclusion.IsExcluded(document_id) || !rating_filter.IsCandidate(document_id)) {
+						continue;
+					}
+					const auto& document_data = documents_.at(document_id);
+					if (rating_filter.Admits(document_data.rating) && document_predicate(document_id, document_data.status, document_data.rating)) {
+						block_relevance.push_back({document_id, term_freq * inverse_document_freq});
 					}
-					document_to_relevance[document_id] += term_freq * inverse_document_freq;
 				}
-			}
+				std::lock_guard<std::mutex> guard(mtx);
+				for (const auto& [document_id, relevance] : block_relevance) {
+					document_to_relevance[document_id] += relevance;
+				}
+			} );
 		}
-		for (const std::string_view word : query.minus_words) {
-			if (word_to_document_freqs_.count(std::string(word)) == 0) {
-				continue;
+		
+		std::vector<Document> matched_documents;
+		for (const auto [document_id, relevance] : document_to_relevance) {
+			matched_documents.push_back({document_id, relevance, documents_.at(document_id).rating});
+		}
+		return matched_documents;
+	}
+
+	template <typename DocumentPredicate>
+	std::vector<Document> FindAllDocuments(std::execution::sequenced_policy, const Query& query, const DocumentPredicate& document_predicate,
+	                                       const QueryBudget* budget = nullptr, const RatingRange* rating_range = nullptr) const {
+		std::shared_lock index_lock(index_mutex_);
+		const RatingFilter rating_filter = BuildRatingFilter(query, rating_range);
+		const bool is_impact = IsImpactScored(query);
+		if (rating_filter.is_filter_first_) {
+			return FindAllDocumentsInRange(false, is_impact, rating_filter, query, document_predicate, budget);
+		}
+		if (is_impact) {
+			return FindAllDocumentsByImpact(false, query, document_predicate, budget, rating_filter);
+		}
+		const ExclusionFilter exclusion = BuildExclusionFilter(query);
+		std::map<int, double> document_to_relevance;
+		for (const ScoredTerm& term : ResolvePlusTerms(query)) {
+			if (!IsWithinBudget(budget)) {
+				break;
 			}
-			for (const auto [document_id, _] : word_to_document_freqs_.at(std::string(word))) {
-				document_to_relevance.erase(document_id);
+			const double inverse_document_freq = term.inverse_document_freq;
+			const std::vector<PostingSpan> blocks = SplitIntoBlocks(term.spans);
+			for (size_t block = 0; block < blocks.size(); ++block) {
+				if (block > 0 && !IsWithinBudget(budget)) {
+					break;
+				}
+				for (const Posting* posting = blocks[block].begin; posting != blocks[block].end; ++posting) {
+					const auto [document_id, term_freq] = *posting;
+					if (blocks[block].IsDeleted(document_id) || exclusion.IsExcluded(document_id) || !rating_filter.IsCandidate(document_id)) {
+						continue;
+					}
+					const auto& document_data = documents_.at(document_id);
+					if (rating_filter.Admits(document_data.rating) && document_predicate(document_id, document_data.status, document_data.rating)) {
+						document_to_relevance[document_id] += term_freq * inverse_document_freq;
+					}
+				}
 			}
 		}
 		std::vector<Document> matched_documents;
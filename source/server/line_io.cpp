@@ -0,0 +1,107 @@
+#include "line_io.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+	const size_t READ_CHUNK_SIZE = 64 * 1024;
+	const int LISTEN_BACKLOG = 64;
+	
+	sockaddr_un MakeAddress(const string& path) {
+		sockaddr_un address{};
+		if (path.size() >= sizeof(address.sun_path)) {
+			throw invalid_argument("Socket path is too long: "s + path);
+		}
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+		return address;
+	}
+	
+	int OpenUnixSocket() {
+		const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) {
+			throw system_error(errno, generic_category(), "Cannot create socket"s);
+		}
+		return fd;
+	}
+} // namespace
+
+LineReader::LineReader(int fd)
+		: fd_(fd)
+		{}
+
+vector<string> LineReader::ReadAvailableLines() {
+	vector<string> lines;
+	while (lines.empty() && !is_over_) {
+		const size_t old_size = buffer_.size();
+		buffer_.resize(old_size + READ_CHUNK_SIZE);
+		const ssize_t read_size = read(fd_, buffer_.data() + old_size, READ_CHUNK_SIZE);
+		if (read_size < 0) {
+			buffer_.resize(old_size);
+			if (errno == EINTR) {
+				continue;
+			}
+			throw system_error(errno, generic_category(), "Cannot read requests"s);
+		}
+		buffer_.resize(old_size + read_size);
+		is_over_ = read_size == 0;
+		
+		size_t line_begin = 0;
+		for (size_t line_end = buffer_.find('\n'); line_end != string::npos; line_end = buffer_.find('\n', line_begin)) {
+			lines.push_back(buffer_.substr(line_begin, line_end - line_begin));
+			line_begin = line_end + 1;
+		}
+		buffer_.erase(0, line_begin);
+		// The last line may lack its newline
+		if (is_over_ && !buffer_.empty()) {
+			lines.push_back(move(buffer_));
+			buffer_.clear();
+		}
+	}
+	return lines;
+}
+
+void WriteAll(int fd, string_view data) {
+	while (!data.empty()) {
+		const ssize_t written = write(fd, data.data(), data.size());
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throw system_error(errno, generic_category(), "Cannot write responses"s);
+		}
+		data.remove_prefix(written);
+	}
+}
+
+int ListenUnixSocket(const string& path) {
+	const sockaddr_un address = MakeAddress(path);
+	const int fd = OpenUnixSocket();
+	unlink(path.c_str());
+	if (bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0
+	    || listen(fd, LISTEN_BACKLOG) < 0) {
+		const int error = errno;
+		close(fd);
+		throw system_error(error, generic_category(), "Cannot listen on "s + path);
+	}
+	return fd;
+}
+
+int ConnectUnixSocket(const string& path) {
+	const sockaddr_un address = MakeAddress(path);
+	const int fd = OpenUnixSocket();
+	if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+		const int error = errno;
+		close(fd);
+		throw system_error(error, generic_category(), "Cannot connect to "s + path);
+	}
+	return fd;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Newline-delimited reading from a file descriptor: a pipe, a socket or stdin
+class LineReader {
+public:
+	explicit LineReader(int fd);
+	
+	// Blocks until at least one complete line arrives and returns every complete line received
+	// so far, without the newlines. Empty once the input is over. Throws std::system_error
+	std::vector<std::string> ReadAvailableLines();
+
+private:
+	int fd_;
+	std::string buffer_;
+	bool is_over_ = false;
+};
+
+// Throws std::system_error, e.g. when the peer has gone
+void WriteAll(int fd, std::string_view data);
+
+// Binds a Unix domain socket to path, replacing a stale socket file
+int ListenUnixSocket(const std::string& path);
+
+int ConnectUnixSocket(const std::string& path);
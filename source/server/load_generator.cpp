@@ -0,0 +1,182 @@
+#include "line_io.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct LoadOptions {
+	string socket_path;
+	string queries_path; // stdin when empty
+	int connection_count = 4;
+	int request_count = 10000;
+	int pipeline_depth = 16; // requests in flight per connection
+};
+
+void PrintUsage() {
+	cerr << "Usage: SearchLoadGenerator --socket path [--queries file] [--connections count] [--requests count]"s
+	     << " [--pipeline depth]"s << endl;
+}
+
+LoadOptions ParseOptions(int argc, char* argv[]) {
+	LoadOptions options;
+	for (int i = 1; i < argc; ++i) {
+		const string argument = argv[i];
+		if (i + 1 == argc) {
+			throw invalid_argument("Missing value of "s + argument);
+		}
+		const string value = argv[++i];
+		if (argument == "--socket"s) {
+			options.socket_path = value;
+		}
+		else if (argument == "--queries"s) {
+			options.queries_path = value;
+		}
+		else if (argument == "--connections"s) {
+			options.connection_count = stoi(value);
+		}
+		else if (argument == "--requests"s) {
+			options.request_count = stoi(value);
+		}
+		else if (argument == "--pipeline"s) {
+			options.pipeline_depth = stoi(value);
+		}
+		else {
+			throw invalid_argument("Unknown option "s + argument);
+		}
+	}
+	if (options.socket_path.empty()) {
+		throw invalid_argument("No socket given"s);
+	}
+	if (options.connection_count <= 0 || options.request_count <= 0 || options.pipeline_depth <= 0) {
+		throw invalid_argument("Counts must be positive"s);
+	}
+	return options;
+}
+
+vector<string> ReadQueries(istream& input) {
+	vector<string> queries;
+	for (string line; getline(input, line);) {
+		if (!line.empty()) {
+			queries.push_back(line);
+		}
+	}
+	if (queries.empty()) {
+		throw invalid_argument("No queries given"s);
+	}
+	return queries;
+}
+
+struct ConnectionStats {
+	vector<chrono::microseconds> latencies;
+	int error_count = 0;
+};
+
+// Keeps pipeline_depth requests in flight: sends a window of searches in one write, then
+// reads their responses. The latency of a request runs from sending its window to its response
+ConnectionStats RunConnection(const LoadOptions& options, const vector<string>& queries, int first_request, int request_count) {
+	ConnectionStats stats;
+	stats.latencies.reserve(request_count);
+	const int fd = ConnectUnixSocket(options.socket_path);
+	LineReader reader(fd);
+	try {
+		for (int sent = 0; sent < request_count;) {
+			const int window = min(options.pipeline_depth, request_count - sent);
+			string requests;
+			for (int i = 0; i < window; ++i) {
+				requests += "search "s + queries[(first_request + sent + i) % queries.size()] + '\n';
+			}
+			const Clock::time_point send_time = Clock::now();
+			WriteAll(fd, requests);
+			for (int received = 0; received < window;) {
+				const vector<string> responses = reader.ReadAvailableLines();
+				if (responses.empty()) {
+					throw runtime_error("Server closed the connection"s);
+				}
+				const auto latency = chrono::duration_cast<chrono::microseconds>(Clock::now() - send_time);
+				for (const string& response : responses) {
+					stats.latencies.push_back(latency);
+					stats.error_count += response.substr(0, 2) != "ok"s;
+				}
+				received += responses.size();
+			}
+			sent += window;
+		}
+	} catch (...) {
+		close(fd);
+		throw;
+	}
+	close(fd);
+	return stats;
+}
+
+int main(int argc, char* argv[]) {
+	try {
+		const LoadOptions options = ParseOptions(argc, argv);
+		vector<string> queries;
+		if (options.queries_path.empty()) {
+			queries = ReadQueries(cin);
+		}
+		else {
+			ifstream input(options.queries_path);
+			if (!input) {
+				throw invalid_argument("Cannot open "s + options.queries_path);
+			}
+			queries = ReadQueries(input);
+		}
+		
+		vector<ConnectionStats> stats(options.connection_count);
+		vector<thread> connections;
+		mutex error_mutex;
+		string error;
+		const Clock::time_point start_time = Clock::now();
+		for (int i = 0; i < options.connection_count; ++i) {
+			const int first_request = options.request_count * i / options.connection_count;
+			const int request_count = options.request_count * (i + 1) / options.connection_count - first_request;
+			connections.emplace_back([&, i, first_request, request_count] {
+				try {
+					stats[i] = RunConnection(options, queries, first_request, request_count);
+				} catch (const exception& e) {
+					lock_guard lock(error_mutex);
+					error = e.what();
+				}
+			});
+		}
+		for (thread& connection : connections) {
+			connection.join();
+		}
+		const chrono::duration<double> elapsed = Clock::now() - start_time;
+		if (!error.empty()) {
+			throw runtime_error(error);
+		}
+		
+		vector<chrono::microseconds> latencies;
+		int error_count = 0;
+		for (const ConnectionStats& connection_stats : stats) {
+			latencies.insert(latencies.end(), connection_stats.latencies.begin(), connection_stats.latencies.end());
+			error_count += connection_stats.error_count;
+		}
+		sort(latencies.begin(), latencies.end());
+		const auto percentile = [&latencies](double fraction) {
+			return latencies[min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()))].count();
+		};
+		cout << "requests: "s << latencies.size() << ", errors: "s << error_count << ", time: "s << elapsed.count() << " s"s
+		     << ", QPS: "s << latencies.size() / elapsed.count() << endl;
+		cout << "latency, us: p50 = "s << percentile(0.5) << ", p90 = "s << percentile(0.9) << ", p99 = "s << percentile(0.99)
+		     << ", max = "s << latencies.back().count() << endl;
+	} catch (const exception& e) {
+		cerr << e.what() << endl;
+		PrintUsage();
+		return 1;
+	}
+}
@@ -0,0 +1,129 @@
+#include "query_service.h"
+
+#include <charconv>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+using namespace std;
+
+namespace {
+	// Splits off the first space-separated token and the spaces after it
+	string_view TakeToken(string_view& text) {
+		text.remove_prefix(min(text.find_first_not_of(' '), text.size()));
+		const size_t token_end = min(text.find(' '), text.size());
+		const string_view token = text.substr(0, token_end);
+		text.remove_prefix(min(text.find_first_not_of(' ', token_end), text.size()));
+		return token;
+	}
+	
+	int ParseInt(string_view text) {
+		int value = 0;
+		const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+		if (error != errc() || end != text.data() + text.size()) {
+			throw invalid_argument("Invalid number "s + string(text));
+		}
+		return value;
+	}
+	
+	vector<int> ParseRatings(string_view text) {
+		vector<int> ratings;
+		if (text == "-"sv) {
+			return ratings;
+		}
+		while (!text.empty()) {
+			const size_t comma = min(text.find(','), text.size());
+			ratings.push_back(ParseInt(text.substr(0, comma)));
+			text.remove_prefix(min(comma + 1, text.size()));
+		}
+		return ratings;
+	}
+} // namespace
+
+QueryService::QueryService(SearchServer& search_server)
+		: search_server_(search_server)
+		{}
+
+vector<string> QueryService::ProcessBatch(const vector<string>& requests) {
+	vector<string> responses(requests.size());
+	for (size_t run_begin = 0; run_begin < requests.size();) {
+		if (!IsReadOnly(requests[run_begin])) {
+			responses[run_begin] = ProcessRequest(requests[run_begin]);
+			++run_begin;
+			continue;
+		}
+		size_t run_end = run_begin;
+		while (run_end < requests.size() && IsReadOnly(requests[run_end])) {
+			++run_end;
+		}
+		search_server_.GetThreadPool().ParallelFor(run_end - run_begin, [&](size_t i) {
+			responses[run_begin + i] = ProcessRequest(requests[run_begin + i]);
+		});
+		run_begin = run_end;
+	}
+	return responses;
+}
+
+string QueryService::ProcessRequest(string_view request) {
+	try {
+		const string_view command = TakeToken(request);
+		if (command == "search"sv) {
+			return Search(request);
+		}
+		if (command == "match"sv) {
+			return Match(request);
+		}
+		if (command == "add"sv) {
+			return Add(request);
+		}
+		if (command == "remove"sv) {
+			return Remove(request);
+		}
+		throw invalid_argument("Unknown command "s + string(command));
+	} catch (const exception& e) {
+		return "error "s + e.what();
+	}
+}
+
+string QueryService::Search(string_view query) const {
+	ostringstream response;
+	response << "ok"s;
+	for (const Document& document : search_server_.FindTopDocuments(query)) {
+		response << ' ' << document.id << ':' << document.relevance << ':' << document.rating;
+	}
+	return response.str();
+}
+
+string QueryService::Match(string_view arguments) const {
+	const int document_id = ParseInt(TakeToken(arguments));
+	vector<string> words;
+	DocumentStatus status;
+	// Checked by MatchDocument itself, so a concurrent remove cannot slip in between
+	try {
+		tie(words, status) = search_server_.MatchDocument(arguments, document_id);
+	} catch (const out_of_range&) {
+		throw invalid_argument("No document "s + to_string(document_id));
+	}
+	string response = "ok "s + to_string(static_cast<int>(status));
+	for (const string& word : words) {
+		response.push_back(' ');
+		response += word;
+	}
+	return response;
+}
+
+string QueryService::Add(string_view arguments) {
+	const int document_id = ParseInt(TakeToken(arguments));
+	const vector<int> ratings = ParseRatings(TakeToken(arguments));
+	search_server_.AddDocument(document_id, arguments, DocumentStatus::ACTUAL, ratings);
+	return "ok"s;
+}
+
+string QueryService::Remove(string_view arguments) {
+	search_server_.RemoveDocument(ParseInt(TakeToken(arguments)));
+	return "ok"s;
+}
+
+bool QueryService::IsReadOnly(string_view request) {
+	return request.substr(0, 7) == "search "sv || request.substr(0, 6) == "match "sv;
+}
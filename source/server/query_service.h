@@ -0,0 +1,37 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Answers newline-delimited requests, one response line each:
+//   search <query>                          ok <id>:<relevance>:<rating> ...
+//   match <document_id> <query>             ok <status> <word> ...
+//   add <document_id> <ratings> <text>      ok        (ratings comma-separated, "-" for none)
+//   remove <document_id>                    ok
+// A request that fails is answered with "error <message>"
+class QueryService {
+public:
+	explicit QueryService(SearchServer& search_server);
+	
+	// Responses in request order. Consecutive searches and matches run together on the
+	// thread pool of the server, while adds and removes apply between them in order
+	std::vector<std::string> ProcessBatch(const std::vector<std::string>& requests);
+
+private:
+	SearchServer& search_server_;
+	
+	std::string ProcessRequest(std::string_view request);
+	
+	std::string Search(std::string_view query) const;
+	
+	std::string Match(std::string_view arguments) const;
+	
+	std::string Add(std::string_view arguments);
+	
+	std::string Remove(std::string_view arguments);
+	
+	static bool IsReadOnly(std::string_view request);
+};
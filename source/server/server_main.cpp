@@ -0,0 +1,202 @@
+#include "line_io.h"
+#include "mapped_corpus.h"
+#include "query_service.h"
+#include "search_server.h"
+
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+struct DaemonOptions {
+	string stop_words;
+	string corpus_path;
+	CorpusFormat corpus_format = CorpusFormat::NEWLINE_DELIMITED;
+	string socket_path; // stdin and stdout when empty
+	size_t thread_count = 0; // the default pool when zero
+	bool pin_threads = false;
+};
+
+void PrintUsage() {
+	cerr << "Usage: SearchDaemon [--stop-words \"words\"] [--corpus path [--length-prefixed]] [--socket path]"s
+	     << " [--threads count [--pin]]"s << endl;
+}
+
+DaemonOptions ParseOptions(int argc, char* argv[]) {
+	DaemonOptions options;
+	for (int i = 1; i < argc; ++i) {
+		const string argument = argv[i];
+		const auto next_value = [&]() -> string {
+			if (i + 1 == argc) {
+				throw invalid_argument("Missing value of "s + argument);
+			}
+			return argv[++i];
+		};
+		if (argument == "--stop-words"s) {
+			options.stop_words = next_value();
+		}
+		else if (argument == "--corpus"s) {
+			options.corpus_path = next_value();
+		}
+		else if (argument == "--length-prefixed"s) {
+			options.corpus_format = CorpusFormat::LENGTH_PREFIXED;
+		}
+		else if (argument == "--socket"s) {
+			options.socket_path = next_value();
+		}
+		else if (argument == "--threads"s) {
+			options.thread_count = stoul(next_value());
+		}
+		else if (argument == "--pin"s) {
+			options.pin_threads = true;
+		}
+		else {
+			throw invalid_argument("Unknown option "s + argument);
+		}
+	}
+	return options;
+}
+
+// Every read brings a batch of the requests that have arrived so far; the responses of
+// a batch go out in one write while the client may already be sending the next one
+void ServeConnection(QueryService& service, int input_fd, int output_fd) {
+	LineReader reader(input_fd);
+	for (vector<string> requests = reader.ReadAvailableLines(); !requests.empty(); requests = reader.ReadAvailableLines()) {
+		string responses;
+		for (const string& response : service.ProcessBatch(requests)) {
+			responses += response;
+			responses.push_back('\n');
+		}
+		WriteAll(output_fd, responses);
+	}
+}
+
+// Connection threads stay joinable, so that they never outlive the service they use
+class ConnectionThreads {
+public:
+	explicit ConnectionThreads(QueryService& service)
+			: service_(service) {}
+	
+	// Shuts the open connections down and waits for their threads
+	~ConnectionThreads() {
+		{
+			lock_guard lock(mutex_);
+			for (Connection& connection : connections_) {
+				if (!connection.is_finished) {
+					shutdown(connection.fd, SHUT_RDWR);
+				}
+			}
+		}
+		for (Connection& connection : connections_) {
+			connection.worker.join();
+			close(connection.fd);
+		}
+	}
+	
+	ConnectionThreads(const ConnectionThreads&) = delete;
+	ConnectionThreads& operator=(const ConnectionThreads&) = delete;
+	
+	void Start(int connection_fd) {
+		JoinFinished();
+		lock_guard lock(mutex_);
+		Connection& connection = connections_.emplace_back();
+		connection.fd = connection_fd;
+		connection.worker = thread([this, &connection] {
+			try {
+				ServeConnection(service_, connection.fd, connection.fd);
+			} catch (const system_error& e) {
+				cerr << e.what() << endl;
+			}
+			lock_guard lock(mutex_);
+			connection.is_finished = true;
+		});
+	}
+
+private:
+	struct Connection {
+		thread worker;
+		int fd = -1; // closed by the joining thread, so that shutdown never hits a reused descriptor
+		bool is_finished = false; // guarded by mutex_
+	};
+	
+	QueryService& service_;
+	mutex mutex_;
+	list<Connection> connections_;
+	
+	void JoinFinished() {
+		list<Connection> finished;
+		{
+			lock_guard lock(mutex_);
+			for (auto connection = connections_.begin(); connection != connections_.end();) {
+				const auto next = std::next(connection);
+				if (connection->is_finished) {
+					finished.splice(finished.end(), connections_, connection);
+				}
+				connection = next;
+			}
+		}
+		for (Connection& connection : finished) {
+			connection.worker.join();
+			close(connection.fd);
+		}
+	}
+};
+
+void ServeSocket(QueryService& service, const string& socket_path) {
+	const int listen_fd = ListenUnixSocket(socket_path);
+	cerr << "Listening on "s << socket_path << endl;
+	ConnectionThreads connections(service);
+	while (true) {
+		const int connection_fd = accept(listen_fd, nullptr, nullptr);
+		if (connection_fd < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			const int error = errno;
+			close(listen_fd);
+			throw system_error(error, generic_category(), "Cannot accept a connection"s);
+		}
+		connections.Start(connection_fd);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	// A client that disconnects must fail the write, not kill the daemon
+	signal(SIGPIPE, SIG_IGN);
+	try {
+		const DaemonOptions options = ParseOptions(argc, argv);
+		SearchServer search_server(options.stop_words);
+		if (options.thread_count > 0) {
+			search_server.SetThreadPool(make_shared<ThreadPool>(options.thread_count, options.pin_threads));
+		}
+		if (!options.corpus_path.empty()) {
+			const auto start_time = chrono::steady_clock::now();
+			const int document_count = search_server.AddDocuments(
+					make_shared<const MappedCorpus>(options.corpus_path, options.corpus_format), 0, DocumentStatus::ACTUAL, {});
+			cerr << "Indexed "s << document_count << " documents in "s
+			     << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start_time).count() << " ms"s << endl;
+		}
+		
+		QueryService service(search_server);
+		if (options.socket_path.empty()) {
+			ServeConnection(service, STDIN_FILENO, STDOUT_FILENO);
+		}
+		else {
+			ServeSocket(service, options.socket_path);
+		}
+	} catch (const exception& e) {
+		cerr << e.what() << endl;
+		PrintUsage();
+		return 1;
+	}
+}
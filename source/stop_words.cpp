@@ -0,0 +1,37 @@
+#include "stop_words.h"
+
+#include <algorithm>
+
+using namespace std;
+
+vector<string_view> StopWordFilter::GetWords() const {
+	vector<string_view> words;
+	for (const Slot slot : slots_) {
+		if (slot.length > 0) {
+			words.push_back(string_view(storage_).substr(slot.offset, slot.length));
+		}
+	}
+	return words;
+}
+
+void StopWordFilter::Build(const vector<string_view>& words) {
+	vector<uint32_t> bucket_begins(GetStopWordBucketCount(words.size()) + 1);
+	vector<uint32_t> bucket_words(words.size());
+	vector<uint32_t> slot_words(GetStopWordSlotCount(words.size()));
+	pilots_.assign(bucket_begins.size() - 1, 0);
+	BuildStopWordHash(words, bucket_begins, bucket_words, pilots_, slot_words);
+	slots_.assign(slot_words.size(), Slot());
+	for (size_t i = 0; i < slot_words.size(); ++i) {
+		if (slot_words[i] != 0) {
+			slots_[i] = Store(words[slot_words[i] - 1]);
+		}
+	}
+}
+
+StopWordFilter::Slot StopWordFilter::Store(string_view word) {
+	Slot slot;
+	slot.offset = static_cast<uint32_t>(storage_.size());
+	slot.length = static_cast<uint32_t>(word.size());
+	storage_.append(word);
+	return slot;
+}
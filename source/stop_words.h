@@ -0,0 +1,219 @@
+#pragma once
+
+#include "string_processing.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// FNV-1a shared by the run-time and compile-time stop-word tables
+constexpr uint64_t HashStopWord(std::string_view word) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (const char c : word) {
+		hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+	}
+	return hash ^ (hash >> 29);
+}
+
+constexpr uint64_t MAX_STOP_WORD_PILOT = 1 << 16;
+
+// About two words per bucket
+constexpr size_t GetStopWordBucketCount(size_t word_count) {
+	return word_count / 2 + 1;
+}
+
+// A fifth of the slots stays free, so that a pilot is found in a few tries
+constexpr size_t GetStopWordSlotCount(size_t word_count) {
+	return word_count + word_count / 4 + 1;
+}
+
+constexpr size_t GetStopWordBucket(uint64_t hash, size_t bucket_count) {
+	return (hash >> 32) % bucket_count;
+}
+
+constexpr size_t GetStopWordSlot(uint64_t hash, uint64_t pilot, size_t slot_count) {
+	uint64_t pilot_hash = (pilot + 1) * 0x9e3779b97f4a7c15ULL;
+	pilot_hash ^= pilot_hash >> 31;
+	return (hash ^ pilot_hash) % slot_count;
+}
+
+// Hash-and-displace: a word falls into a bucket by its hash, and each bucket gets the first pilot
+// that sends all its words to free slots. Buckets are placed largest first, while the table is
+// still empty. Fills slot_words with word index + 1, 0 for a free slot; empty and repeated words
+// take no slot. The scratch arrays hold bucket_count + 1 and words.size() entries
+template <typename Words, typename BucketBegins, typename BucketWords, typename Pilots, typename SlotWords>
+constexpr void BuildStopWordHash(const Words& words, BucketBegins& bucket_begins, BucketWords& bucket_words,
+                                 Pilots& pilots, SlotWords& slot_words) {
+	const size_t bucket_count = pilots.size();
+	const size_t slot_count = slot_words.size();
+	for (auto& begin : bucket_begins) {
+		begin = 0;
+	}
+	for (auto& slot_word : slot_words) {
+		slot_word = 0;
+	}
+	// Counting sort of the words by bucket
+	size_t word_count = 0;
+	for (const std::string_view word : words) {
+		if (!word.empty()) {
+			++bucket_begins[GetStopWordBucket(HashStopWord(word), bucket_count) + 1];
+			++word_count;
+		}
+	}
+	size_t max_bucket_size = 0;
+	for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+		max_bucket_size = std::max<size_t>(max_bucket_size, bucket_begins[bucket + 1]);
+		bucket_begins[bucket + 1] += bucket_begins[bucket];
+	}
+	for (size_t i = 0; i < words.size(); ++i) {
+		if (!words[i].empty()) {
+			bucket_words[bucket_begins[GetStopWordBucket(HashStopWord(words[i]), bucket_count)]++] = static_cast<uint32_t>(i);
+		}
+	}
+	for (size_t bucket = bucket_count; bucket > 0; --bucket) {
+		bucket_begins[bucket] = bucket_begins[bucket - 1];
+	}
+	bucket_begins[0] = 0;
+
+	for (size_t bucket_size = max_bucket_size; bucket_size > 0; --bucket_size) {
+		for (size_t bucket = 0; bucket < bucket_count; ++bucket) {
+			const size_t begin = bucket_begins[bucket];
+			const size_t end = bucket_begins[bucket + 1];
+			if (end - begin != bucket_size) {
+				continue;
+			}
+			for (uint64_t pilot = 0;; ++pilot) {
+				if (pilot == MAX_STOP_WORD_PILOT) {
+					throw std::invalid_argument("No perfect hash for stop words");
+				}
+				bool fits = true;
+				for (size_t i = begin; i < end && fits; ++i) {
+					const std::string_view word = words[bucket_words[i]];
+					bool is_repeated = false;
+					for (size_t j = begin; j < i; ++j) {
+						is_repeated = is_repeated || words[bucket_words[j]] == word;
+					}
+					if (is_repeated) {
+						continue;
+					}
+					auto& slot_word = slot_words[GetStopWordSlot(HashStopWord(word), pilot, slot_count)];
+					if (slot_word != 0) {
+						fits = false;
+					} else {
+						slot_word = bucket_words[i] + 1;
+					}
+				}
+				if (fits) {
+					pilots[bucket] = static_cast<uint16_t>(pilot);
+					break;
+				}
+				for (size_t i = begin; i < end; ++i) {
+					auto& slot_word = slot_words[GetStopWordSlot(HashStopWord(words[bucket_words[i]]), pilot, slot_count)];
+					if (slot_word == bucket_words[i] + 1) {
+						slot_word = 0;
+					}
+				}
+			}
+		}
+	}
+}
+
+// Stop words fixed at compile time, hashed into a perfect hash table by the compiler:
+//     constexpr auto stop_words = MakeStopWords("and", "in", "on");
+template <size_t N>
+class StaticStopWords {
+public:
+	static constexpr size_t BUCKET_COUNT = GetStopWordBucketCount(N);
+	static constexpr size_t SLOT_COUNT = GetStopWordSlotCount(N);
+	
+	constexpr explicit StaticStopWords(const std::array<std::string_view, N>& words) {
+		for (const std::string_view word : words) {
+			for (const char c : word) {
+				if (c >= '\0' && c < ' ') {
+					throw std::invalid_argument("Some of stop words are invalid");
+				}
+			}
+		}
+		std::array<uint32_t, BUCKET_COUNT + 1> bucket_begins{};
+		std::array<uint32_t, N> bucket_words{};
+		std::array<uint32_t, SLOT_COUNT> slot_words{};
+		BuildStopWordHash(words, bucket_begins, bucket_words, pilots_, slot_words);
+		for (size_t i = 0; i < SLOT_COUNT; ++i) {
+			slots_[i] = slot_words[i] != 0 ? words[slot_words[i] - 1] : std::string_view();
+		}
+	}
+	
+	constexpr bool Contains(std::string_view word) const {
+		const uint64_t hash = HashStopWord(word);
+		return !word.empty() && slots_[GetStopWordSlot(hash, pilots_[GetStopWordBucket(hash, BUCKET_COUNT)], SLOT_COUNT)] == word;
+	}
+	
+	constexpr const std::array<uint16_t, BUCKET_COUNT>& GetPilots() const {
+		return pilots_;
+	}
+	
+	// Empty views mark free slots
+	constexpr const std::array<std::string_view, SLOT_COUNT>& GetSlots() const {
+		return slots_;
+	}
+
+private:
+	std::array<uint16_t, BUCKET_COUNT> pilots_{};
+	std::array<std::string_view, SLOT_COUNT> slots_{};
+};
+
+template <typename... Words>
+constexpr StaticStopWords<sizeof...(Words)> MakeStopWords(const Words&... words) {
+	return StaticStopWords<sizeof...(Words)>(std::array<std::string_view, sizeof...(Words)>{std::string_view(words)...});
+}
+
+// Owned copy of the stop words behind the same hash-and-displace table, so a lookup is one
+// hash, two array loads and at most one comparison
+class StopWordFilter {
+public:
+	template <typename StringContainer>
+	explicit StopWordFilter(const StringContainer& stop_words) {
+		std::vector<std::string_view> words;
+		for (const std::string_view word : MakeUniqueNonEmptyStrings(stop_words)) {
+			words.push_back(word);
+		}
+		Build(words);
+	}
+	
+	template <size_t N>
+	explicit StopWordFilter(const StaticStopWords<N>& stop_words)
+			: pilots_(stop_words.GetPilots().begin(), stop_words.GetPilots().end())
+			, slots_(StaticStopWords<N>::SLOT_COUNT) {
+		for (size_t i = 0; i < slots_.size(); ++i) {
+			slots_[i] = Store(stop_words.GetSlots()[i]);
+		}
+	}
+	
+	bool Contains(std::string_view word) const {
+		const uint64_t hash = HashStopWord(word);
+		const Slot slot = slots_[GetStopWordSlot(hash, pilots_[GetStopWordBucket(hash, pilots_.size())], slots_.size())];
+		return slot.length == word.size() && slot.length > 0
+		       && std::memcmp(storage_.data() + slot.offset, word.data(), word.size()) == 0;
+	}
+	
+	std::vector<std::string_view> GetWords() const;
+
+private:
+	struct Slot {
+		uint32_t offset = 0;
+		uint32_t length = 0; // 0 for a free slot
+	};
+	
+	std::string storage_; // all stop words back to back
+	std::vector<uint16_t> pilots_;
+	std::vector<Slot> slots_;
+	
+	void Build(const std::vector<std::string_view>& words);
+	
+	Slot Store(std::string_view word);
+};
@@ -0,0 +1,125 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+
+using namespace std;
+
+FrontCodedTerms::FrontCodedTerms(const CountingAllocator<char>& allocator)
+		: data_(allocator)
+		, block_offsets_(allocator)
+		, last_term_(allocator)
+		{}
+
+void FrontCodedTerms::Append(string_view term) {
+	size_t shared_length = 0;
+	if (term_count_ % TERMS_PER_BLOCK == 0) {
+		block_offsets_.push_back(static_cast<uint32_t>(data_.size()));
+	}
+	else {
+		const size_t max_shared_length = min(term.size(), last_term_.size());
+		while (shared_length < max_shared_length && term[shared_length] == last_term_[shared_length]) {
+			++shared_length;
+		}
+	}
+	AppendLength(shared_length);
+	AppendLength(term.size() - shared_length);
+	data_.append(term.substr(shared_length));
+	last_term_.assign(term);
+	++term_count_;
+}
+
+size_t FrontCodedTerms::size() const {
+	return term_count_;
+}
+
+void FrontCodedTerms::AppendLength(size_t length) {
+	while (length >= 0x80) {
+		data_.push_back(static_cast<char>((length & 0x7F) | 0x80));
+		length >>= 7;
+	}
+	data_.push_back(static_cast<char>(length));
+}
+
+size_t FrontCodedTerms::ReadLength(size_t& offset) const {
+	size_t length = 0;
+	for (int shift = 0;; shift += 7) {
+		const auto byte = static_cast<unsigned char>(data_[offset++]);
+		length |= static_cast<size_t>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return length;
+		}
+	}
+}
+
+void FrontCodedTerms::ReadTerm(size_t& offset, string& term) const {
+	const size_t shared_length = ReadLength(offset);
+	const size_t suffix_length = ReadLength(offset);
+	term.resize(shared_length);
+	term.append(data_.data() + offset, suffix_length);
+	offset += suffix_length;
+}
+
+string_view FrontCodedTerms::GetBlockFirstTerm(size_t block) const {
+	size_t offset = block_offsets_[block];
+	ReadLength(offset); // zero for the first term of a block
+	const size_t length = ReadLength(offset);
+	return string_view(data_).substr(offset, length);
+}
+
+size_t FrontCodedTerms::Find(string_view term) const {
+	// The last block whose first term is not greater than term
+	size_t first = 0;
+	size_t last = block_offsets_.size();
+	while (first < last) {
+		const size_t middle = (first + last) / 2;
+		if (GetBlockFirstTerm(middle) <= term) {
+			first = middle + 1;
+		}
+		else {
+			last = middle;
+		}
+	}
+	if (first == 0) {
+		return NOT_FOUND;
+	}
+	const size_t block = first - 1;
+	size_t offset = block_offsets_[block];
+	string block_term;
+	for (size_t ordinal = block * TERMS_PER_BLOCK; ordinal < min(term_count_, first * TERMS_PER_BLOCK); ++ordinal) {
+		ReadTerm(offset, block_term);
+		if (block_term == term) {
+			return ordinal;
+		}
+		if (block_term > term) {
+			break;
+		}
+	}
+	return NOT_FOUND;
+}
+
+
+FrontCodedTerms::Cursor::Cursor(const FrontCodedTerms& terms)
+		: terms_(&terms)
+{
+	if (IsValid()) {
+		terms_->ReadTerm(offset_, term_);
+	}
+}
+
+bool FrontCodedTerms::Cursor::IsValid() const {
+	return ordinal_ < terms_->term_count_;
+}
+
+string_view FrontCodedTerms::Cursor::GetTerm() const {
+	return term_;
+}
+
+size_t FrontCodedTerms::Cursor::GetOrdinal() const {
+	return ordinal_;
+}
+
+void FrontCodedTerms::Cursor::Next() {
+	if (++ordinal_ < terms_->term_count_) {
+		terms_->ReadTerm(offset_, term_);
+	}
+}
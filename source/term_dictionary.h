@@ -0,0 +1,63 @@
+#pragma once
+
+#include "memory_stats.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Sorted terms, front-coded in blocks of TERMS_PER_BLOCK: the first term of a block is stored
+// whole, every other one as the length of the prefix it shares with the previous term and the
+// rest. Terms are numbered by their position
+class FrontCodedTerms {
+public:
+	static const size_t TERMS_PER_BLOCK = 16;
+	static const size_t NOT_FOUND = static_cast<size_t>(-1);
+	
+	explicit FrontCodedTerms(const CountingAllocator<char>& allocator);
+	
+	// Terms must be appended in increasing order
+	void Append(std::string_view term);
+	
+	size_t size() const;
+	
+	// Binary search over the first terms of the blocks, then a scan of one block
+	size_t Find(std::string_view term) const;
+	
+	// Reads the terms in order
+	class Cursor {
+	public:
+		explicit Cursor(const FrontCodedTerms& terms);
+		
+		bool IsValid() const;
+		
+		// Valid until the next call of Next
+		std::string_view GetTerm() const;
+		
+		size_t GetOrdinal() const;
+		
+		void Next();
+		
+	private:
+		const FrontCodedTerms* terms_;
+		size_t offset_ = 0;
+		size_t ordinal_ = 0;
+		std::string term_;
+	};
+
+private:
+	CountedString data_; // per term: shared length, suffix length, suffix
+	CountedVector<uint32_t> block_offsets_;
+	CountedString last_term_;
+	size_t term_count_ = 0;
+	
+	// Lengths take one byte below 128 and a continuation byte per 7 more bits
+	void AppendLength(size_t length);
+	
+	size_t ReadLength(size_t& offset) const;
+	
+	// Turns term, the term before offset, into the one at offset and moves offset past it
+	void ReadTerm(size_t& offset, std::string& term) const;
+	
+	std::string_view GetBlockFirstTerm(size_t block) const;
+};
@@ -0,0 +1,160 @@
+#include "thread_pool.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+namespace {
+	// Lets Submit from inside a worker push to that worker's own deque
+	thread_local const ThreadPool* current_pool = nullptr;
+	thread_local size_t current_worker_index = 0;
+}
+
+ThreadPool::ThreadPool(size_t worker_count, bool pin_workers)
+		: worker_count_(worker_count)
+{
+	for (size_t i = 0; i <= worker_count; ++i) {
+		queues_.push_back(make_unique<TaskQueue>());
+	}
+	const size_t cpu_count = max(thread::hardware_concurrency(), 1u);
+	for (size_t i = 0; i < worker_count; ++i) {
+		workers_.emplace_back([this, i] { RunWorker(i); });
+		if (pin_workers) {
+			PinToCpu(workers_.back(), i % cpu_count);
+		}
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		lock_guard lock(wake_mutex_);
+		stopping_ = true;
+	}
+	wake_.notify_all();
+	for (thread& worker : workers_) {
+		worker.join();
+	}
+}
+
+size_t ThreadPool::GetWorkerCount() const {
+	return worker_count_;
+}
+
+void ThreadPool::Submit(function<void()> task) {
+	if (worker_count_ == 0) {
+		RunTask(task);
+		return;
+	}
+	const size_t queue_index = current_pool == this ? current_worker_index : worker_count_;
+	{
+		// Counted together with the push, so a worker never takes a task that is not counted yet
+		lock_guard lock(wake_mutex_);
+		{
+			lock_guard queue_lock(queues_[queue_index]->mutex);
+			queues_[queue_index]->tasks.push_back(move(task));
+		}
+		++queued_count_;
+	}
+	wake_.notify_one();
+}
+
+shared_ptr<ThreadPool> ThreadPool::GetDefault() {
+	static const shared_ptr<ThreadPool> pool = make_shared<ThreadPool>();
+	return pool;
+}
+
+void ThreadPool::RunWorker(size_t worker_index) {
+	current_pool = this;
+	current_worker_index = worker_index;
+	function<void()> task;
+	while (true) {
+		if (TryPopTask(worker_index, task)) {
+			RunTask(task);
+			task = nullptr;
+			continue;
+		}
+		unique_lock lock(wake_mutex_);
+		wake_.wait(lock, [this] { return stopping_ || queued_count_ > 0; });
+		if (stopping_ && queued_count_ == 0) {
+			return;
+		}
+	}
+}
+
+void ThreadPool::RunTask(const function<void()>& task) {
+	try {
+		task();
+	} catch (...) {
+	}
+}
+
+bool ThreadPool::TryPopTask(size_t queue_index, function<void()>& task) {
+	bool found = false;
+	{
+		TaskQueue& own_queue = *queues_[queue_index];
+		lock_guard lock(own_queue.mutex);
+		if (!own_queue.tasks.empty()) {
+			task = move(own_queue.tasks.back());
+			own_queue.tasks.pop_back();
+			found = true;
+		}
+	}
+	// Shared queue first, then the other workers starting from the next one
+	for (size_t i = 0; i < worker_count_ && !found; ++i) {
+		const size_t victim_index = i == 0 ? worker_count_ : (queue_index + i) % worker_count_;
+		TaskQueue& victim = *queues_[victim_index];
+		lock_guard lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = move(victim.tasks.front());
+			victim.tasks.pop_front();
+			found = true;
+		}
+	}
+	if (found) {
+		lock_guard lock(wake_mutex_);
+		--queued_count_;
+	}
+	return found;
+}
+
+void ThreadPool::PinToCpu(thread& worker, size_t cpu) {
+#ifdef __linux__
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(cpu, &cpu_set);
+	pthread_setaffinity_np(worker.native_handle(), sizeof(cpu_set), &cpu_set);
+#else
+	(void)worker;
+	(void)cpu;
+#endif
+}
+
+
+ThreadPool::ParallelLoop::ParallelLoop(size_t count)
+		: count(count)
+		{}
+
+void ThreadPool::ParallelLoop::FinishIndex() {
+	if (++finished_count == count) {
+		lock_guard lock(mutex);
+		finished.notify_all();
+	}
+}
+
+void ThreadPool::ParallelLoop::SetException(exception_ptr error) {
+	lock_guard lock(mutex);
+	if (!exception) {
+		exception = error;
+	}
+}
+
+void ThreadPool::ParallelLoop::Wait() {
+	unique_lock lock(mutex);
+	finished.wait(lock, [this] { return finished_count == count; });
+	if (exception) {
+		rethrow_exception(exception);
+	}
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. A worker takes its newest task
+// first and, when its deque is empty, steals the oldest task of another worker
+class ThreadPool {
+public:
+	// With pin_workers, worker i is bound to CPU i modulo the number of CPUs (Linux only)
+	explicit ThreadPool(size_t worker_count = std::thread::hardware_concurrency(), bool pin_workers = false);
+
+	// Runs the tasks already submitted, then stops the workers
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t GetWorkerCount() const;
+
+	// Without workers the task runs on the calling thread. An exception escaping the task is
+	// dropped so that it cannot end a worker; tasks that need to report errors catch them
+	void Submit(std::function<void()> task);
+
+	// Calls body(i) for every i in [0, count) and returns when all calls have finished, rethrowing
+	// the first exception. The calling thread takes indices as well and never waits for a queued
+	// task, so nested calls from inside a worker neither deadlock nor start extra threads
+	template <typename Body>
+	void ParallelFor(size_t count, const Body& body) {
+		if (count == 0) {
+			return;
+		}
+		if (count == 1 || worker_count_ == 0) {
+			for (size_t i = 0; i < count; ++i) {
+				body(i);
+			}
+			return;
+		}
+
+		// Shared with helpers that may start after the loop is over; they find no index left
+		// and never touch body
+		auto loop = std::make_shared<ParallelLoop>(count);
+		const auto run_indices = [loop, &body]() {
+			for (size_t i = loop->next_index++; i < loop->count; i = loop->next_index++) {
+				try {
+					body(i);
+				} catch (...) {
+					loop->SetException(std::current_exception());
+				}
+				loop->FinishIndex();
+			}
+		};
+		const size_t helper_count = std::min(count - 1, worker_count_);
+		for (size_t i = 0; i < helper_count; ++i) {
+			Submit(run_indices);
+		}
+		run_indices();
+		loop->Wait();
+	}
+
+	// Pool shared by servers that were not given their own
+	static std::shared_ptr<ThreadPool> GetDefault();
+
+private:
+	struct TaskQueue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	struct ParallelLoop {
+		explicit ParallelLoop(size_t count);
+
+		void FinishIndex();
+
+		void SetException(std::exception_ptr exception);
+
+		// Blocks until every index has finished and rethrows the first exception
+		void Wait();
+
+		const size_t count;
+		std::atomic<size_t> next_index{0};
+		std::atomic<size_t> finished_count{0};
+		std::mutex mutex;
+		std::condition_variable finished;
+		std::exception_ptr exception;
+	};
+
+	const size_t worker_count_; // read by workers while workers_ is still being filled
+	// One per worker, then one for tasks submitted from outside the pool
+	std::vector<std::unique_ptr<TaskQueue>> queues_;
+	std::vector<std::thread> workers_;
+	std::mutex wake_mutex_;
+	std::condition_variable wake_;
+	size_t queued_count_ = 0; // guarded by wake_mutex_
+	bool stopping_ = false;
+
+	void RunWorker(size_t worker_index);
+
+	static void RunTask(const std::function<void()>& task);
+
+	// Own deque from the back, then the shared queue and other deques from the front
+	bool TryPopTask(size_t queue_index, std::function<void()>& task);
+
+	static void PinToCpu(std::thread& worker, size_t cpu);
+};